@@ -5,9 +5,13 @@
 #include <random>
 
 #include <cmath>
+#include <cstdlib>
 #include <algorithm>
+#include <numeric>
 #include <iterator>
-#include <stack>
+#include <queue>
+#include <thread>
+#include <atomic>
 
 std::minstd_rand rand_engine; // Reasonably quick pseudo-random generator
 
@@ -22,13 +26,435 @@ Type random_in_range(Type start, Type end)
     return static_cast<Type>(start+num);
 }
 
+unsigned worker_count()
+{
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Number of chunks parallel_for splits count items into
+unsigned parallel_chunks(unsigned count, unsigned min_chunk)
+{
+    return std::min(worker_count(), std::max(1u, count / std::max(1u, min_chunk)));
+}
+
+// Calls func(chunk, begin, end) on at most worker_count() chunks of [0, count)
+template <typename Func>
+void parallel_for(unsigned count, unsigned min_chunk, Func func)
+{
+    unsigned chunks = parallel_chunks(count, min_chunk);
+    auto chunk_begin = [count, chunks](unsigned chunk)
+    {
+        return static_cast<unsigned>(static_cast<unsigned long long>(count) * chunk / chunks);
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned chunk = 1; chunk < chunks; ++chunk)
+    {
+        threads.emplace_back(func, chunk, chunk_begin(chunk), chunk_begin(chunk + 1));
+    }
+    func(0u, 0u, chunk_begin(1));
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+// Sorts worker_count() chunks in parallel, then merges them pairwise in parallel
+template <typename Iterator, typename Compare>
+void parallel_sort(Iterator first, Iterator last, Compare comp)
+{
+    unsigned count = last - first;
+    unsigned chunks = std::min(worker_count(), std::max(1u, count / 65536));
+    auto chunk_begin = [first, count, chunks](unsigned chunk)
+    {
+        return first + static_cast<unsigned>(static_cast<unsigned long long>(count) * std::min(chunk, chunks) / chunks);
+    };
+
+    parallel_for(chunks, 1, [&chunk_begin, comp](unsigned, unsigned begin, unsigned end)
+    {
+        for (unsigned chunk = begin; chunk < end; ++chunk)
+        {
+            std::sort(chunk_begin(chunk), chunk_begin(chunk + 1), comp);
+        }
+    });
+    for (unsigned width = 1; width < chunks; width *= 2)
+    {
+        unsigned pairs = (chunks + 2 * width - 1) / (2 * width);
+        parallel_for(pairs, 1, [&chunk_begin, comp, width](unsigned, unsigned begin, unsigned end)
+        {
+            for (unsigned pair = begin; pair < end; ++pair)
+            {
+                unsigned chunk = pair * 2 * width;
+                std::inplace_merge(chunk_begin(chunk), chunk_begin(chunk + width), chunk_begin(chunk + 2 * width), comp);
+            }
+        });
+    }
+}
+
+// Like parallel_for, but workers take grain items at a time from a shared counter
+template <typename Func>
+void parallel_for_dynamic(unsigned count, unsigned grain, unsigned workers, Func func)
+{
+    std::atomic<unsigned> next(0);
+    auto work = [count, grain, &next, &func](unsigned worker)
+    {
+        for (unsigned begin = next.fetch_add(grain); begin < count; begin = next.fetch_add(grain))
+        {
+            func(worker, begin, std::min(count, begin + grain));
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned worker = 1; worker < workers; ++worker)
+    {
+        threads.emplace_back(work, worker);
+    }
+    work(0);
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+BoundingBox merge_boxes(BoundingBox const& b1, BoundingBox const& b2)
+{
+    if (b1.min == NO_COORD)
+    {
+        return b2;
+    }
+    if (b2.min == NO_COORD)
+    {
+        return b1;
+    }
+    return {{std::min(b1.min.x, b2.min.x), std::min(b1.min.y, b2.min.y)},
+            {std::max(b1.max.x, b2.max.x), std::max(b1.max.y, b2.max.y)}};
+}
+
+// Convex if it turns one way at every corner and the edge direction signs change at most twice
+bool is_convex_polygon(std::vector<Coord> const& polygon)
+{
+    std::vector<Coord> edges;
+    for (unsigned i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++)
+    {
+        Coord edge = {polygon[i].x - polygon[j].x, polygon[i].y - polygon[j].y};
+        if (edge.x != 0 || edge.y != 0)
+        {
+            edges.push_back(edge);
+        }
+    }
+    if (edges.size() < 3)
+    {
+        return false;
+    }
+
+    int turn = 0;
+    int x_sign = 0;
+    int y_sign = 0;
+    unsigned x_flips = 0;
+    unsigned y_flips = 0;
+    // Going around twice counts the sign changes over the wrap-around too
+    for (unsigned k = 0; k < 2 * edges.size(); ++k)
+    {
+        Coord e1 = edges[k % edges.size()];
+        Coord e2 = edges[(k + 1) % edges.size()];
+        long long cross = static_cast<long long>(e1.x) * e2.y - static_cast<long long>(e1.y) * e2.x;
+        int sign = (cross > 0) - (cross < 0);
+        if (sign != 0)
+        {
+            if (turn != 0 && sign != turn)
+            {
+                return false;
+            }
+            turn = sign;
+        }
+
+        int sx = (e1.x > 0) - (e1.x < 0);
+        int sy = (e1.y > 0) - (e1.y < 0);
+        if (sx != 0)
+        {
+            x_flips += x_sign != 0 && sx != x_sign && k >= edges.size();
+            x_sign = sx;
+        }
+        if (sy != 0)
+        {
+            y_flips += y_sign != 0 && sy != y_sign && k >= edges.size();
+            y_sign = sy;
+        }
+    }
+    return turn != 0 && x_flips <= 2 && y_flips <= 2;
+}
+
+// twice_size is set to twice the signed size, which is exact
+AreaInfo summarize_polygon(std::vector<Coord> const& polygon, long long& twice_size)
+{
+    AreaInfo info;
+    twice_size = 0;
+    if (polygon.empty())
+    {
+        return info;
+    }
+
+    info.box = {polygon.front(), polygon.front()};
+    double moment_x = 0;
+    double moment_y = 0;
+    double sum_x = 0;
+    double sum_y = 0;
+    for (unsigned i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++)
+    {
+        Coord a = polygon[j];
+        Coord b = polygon[i];
+        info.box = merge_boxes(info.box, {b, b});
+        long long cross = static_cast<long long>(a.x) * b.y - static_cast<long long>(b.x) * a.y;
+        twice_size += cross;
+        moment_x += (static_cast<double>(a.x) + b.x) * cross;
+        moment_y += (static_cast<double>(a.y) + b.y) * cross;
+        info.perimeter += std::hypot(static_cast<double>(b.x) - a.x, static_cast<double>(b.y) - a.y);
+        sum_x += b.x;
+        sum_y += b.y;
+    }
+
+    info.signed_area = twice_size / 2.0;
+    if (twice_size != 0)
+    {
+        info.centroid_x = moment_x / (3.0 * twice_size);
+        info.centroid_y = moment_y / (3.0 * twice_size);
+    }
+    else
+    {
+        // Degenerate polygon, use the mean of the coordinates
+        info.centroid_x = sum_x / polygon.size();
+        info.centroid_y = sum_y / polygon.size();
+    }
+    info.convex = is_convex_polygon(polygon);
+    return info;
+}
+
+// Do segments a1-a2 and b1-b2 have a common point
+bool segments_intersect(Coord a1, Coord a2, Coord b1, Coord b2)
+{
+    auto orientation = [](Coord o, Coord p, Coord q)
+    {
+        long long cross = static_cast<long long>(p.x - o.x) * (q.y - o.y)
+                - static_cast<long long>(p.y - o.y) * (q.x - o.x);
+        return (cross > 0) - (cross < 0);
+    };
+    auto on_segment = [](Coord p, Coord q, Coord xy)
+    {
+        return std::min(p.x, q.x) <= xy.x && xy.x <= std::max(p.x, q.x)
+                && std::min(p.y, q.y) <= xy.y && xy.y <= std::max(p.y, q.y);
+    };
+
+    int o1 = orientation(a1, a2, b1);
+    int o2 = orientation(a1, a2, b2);
+    int o3 = orientation(b1, b2, a1);
+    int o4 = orientation(b1, b2, a2);
+    if (o1 != o2 && o3 != o4)
+    {
+        return true;
+    }
+    return (o1 == 0 && on_segment(a1, a2, b1)) || (o2 == 0 && on_segment(a1, a2, b2))
+            || (o3 == 0 && on_segment(b1, b2, a1)) || (o4 == 0 && on_segment(b1, b2, a2));
+}
+
+// Crossing number test: 1 inside, 0 on the boundary, -1 outside, xy in units of 1/scale
+int polygon_side(std::vector<Coord> const& polygon, Coord xy, int scale = 1)
+{
+    bool inside = false;
+    for (unsigned i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++)
+    {
+        long long ax = static_cast<long long>(polygon[j].x) * scale;
+        long long ay = static_cast<long long>(polygon[j].y) * scale;
+        long long bx = static_cast<long long>(polygon[i].x) * scale;
+        long long by = static_cast<long long>(polygon[i].y) * scale;
+        long long cross = (bx - ax) * (xy.y - ay) - (by - ay) * (xy.x - ax);
+        if (cross == 0
+                && std::min(ax, bx) <= xy.x && xy.x <= std::max(ax, bx)
+                && std::min(ay, by) <= xy.y && xy.y <= std::max(ay, by))
+        {
+            return 0;
+        }
+
+        // The edge crosses the horizontal ray to the right of xy
+        if ((ay > xy.y) != (by > xy.y) && (cross > 0) == (by > ay))
+        {
+            inside = !inside;
+        }
+    }
+    return inside ? 1 : -1;
+}
+
+// Points on the boundary are inside
+bool polygon_contains(std::vector<Coord> const& polygon, Coord xy)
+{
+    return polygon_side(polygon, xy) >= 0;
+}
+
+// Does the polygon (including its inside) have a common point with the box
+bool polygon_intersects_box(std::vector<Coord> const& polygon, BoundingBox const& box)
+{
+    if (polygon.empty())
+    {
+        return false;
+    }
+    if (box_contains(box, polygon.front()) || polygon_contains(polygon, box.min))
+    {
+        return true;
+    }
+
+    // Otherwise the boundaries must cross
+    Coord corners[] = {box.min, {box.max.x, box.min.y}, box.max, {box.min.x, box.max.y}};
+    for (unsigned i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++)
+    {
+        for (unsigned c = 0; c < 4; ++c)
+        {
+            if (segments_intersect(polygon[j], polygon[i], corners[c], corners[(c + 1) % 4]))
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Do the boundaries properly cross, sweeping the edges in the common box by min x
+bool polygon_boundaries_cross(std::vector<Coord> const& polygon1, std::vector<Coord> const& polygon2,
+                              BoundingBox const& common)
+{
+    struct Edge
+    {
+        Coord a;
+        Coord b;
+        unsigned polygon;
+    };
+    std::vector<Edge> edges;
+    for (unsigned p = 0; p < 2; ++p)
+    {
+        auto const& polygon = p == 0 ? polygon1 : polygon2;
+        for (unsigned i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++)
+        {
+            BoundingBox box = {{std::min(polygon[i].x, polygon[j].x), std::min(polygon[i].y, polygon[j].y)},
+                               {std::max(polygon[i].x, polygon[j].x), std::max(polygon[i].y, polygon[j].y)}};
+            if (boxes_intersect(box, common))
+            {
+                edges.push_back({box.min.x == polygon[j].x ? polygon[j] : polygon[i],
+                                 box.min.x == polygon[j].x ? polygon[i] : polygon[j], p});
+            }
+        }
+    }
+    std::sort(edges.begin(), edges.end(), [](Edge const& e1, Edge const& e2) { return e1.a.x < e2.a.x; });
+
+    auto orientation = [](Coord o, Coord p, Coord q)
+    {
+        long long cross = static_cast<long long>(p.x - o.x) * (q.y - o.y)
+                - static_cast<long long>(p.y - o.y) * (q.x - o.x);
+        return (cross > 0) - (cross < 0);
+    };
+
+    std::vector<Edge> active[2];
+    for (auto const& edge : edges)
+    {
+        for (auto& open : active)
+        {
+            open.erase(std::remove_if(open.begin(), open.end(), [&edge](Edge const& e) { return e.b.x < edge.a.x; }),
+                       open.end());
+        }
+        for (auto const& other : active[1 - edge.polygon])
+        {
+            int o1 = orientation(edge.a, edge.b, other.a);
+            int o2 = orientation(edge.a, edge.b, other.b);
+            int o3 = orientation(other.a, other.b, edge.a);
+            int o4 = orientation(other.a, other.b, edge.b);
+            if (o1 * o2 < 0 && o3 * o4 < 0)
+            {
+                return true;
+            }
+        }
+        active[edge.polygon].push_back(edge);
+    }
+    return false;
+}
+
+// Touching polygons don't overlap, crossing edges or a point strictly inside the other do
+bool polygons_overlap(std::vector<Coord> const& polygon1, BoundingBox const& box1,
+                      std::vector<Coord> const& polygon2, BoundingBox const& box2)
+{
+    BoundingBox common = {{std::max(box1.min.x, box2.min.x), std::max(box1.min.y, box2.min.y)},
+                          {std::min(box1.max.x, box2.max.x), std::min(box1.max.y, box2.max.y)}};
+    if (polygon_boundaries_cross(polygon1, polygon2, common))
+    {
+        return true;
+    }
+
+    // Sides of the vertices and edge midpoints of polygon in other, in doubled coordinates
+    auto within = [&common](std::vector<Coord> const& polygon, std::vector<Coord> const& other, bool& strictly_inside)
+    {
+        bool all_within = true;
+        for (unsigned i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++)
+        {
+            Coord points[] = {{2 * polygon[i].x, 2 * polygon[i].y},
+                              {polygon[i].x + polygon[j].x, polygon[i].y + polygon[j].y}};
+            for (Coord xy : points)
+            {
+                if (!box_contains({{2 * common.min.x, 2 * common.min.y}, {2 * common.max.x, 2 * common.max.y}}, xy))
+                {
+                    all_within = false;
+                    continue;
+                }
+                int side = polygon_side(other, xy, 2);
+                if (side > 0)
+                {
+                    strictly_inside = true;
+                    return false;
+                }
+                all_within = all_within && side == 0;
+            }
+        }
+        return all_within;
+    };
+
+    bool strictly_inside = false;
+    bool within1 = within(polygon1, polygon2, strictly_inside);
+    if (strictly_inside)
+    {
+        return true;
+    }
+    bool within2 = within(polygon2, polygon1, strictly_inside);
+    return strictly_inside || (within1 && within2);
+}
+
+double straight_distance(Coord c1, Coord c2)
+{
+    return std::hypot(static_cast<double>(c1.x) - c2.x, static_cast<double>(c1.y) - c2.y);
+}
+
+// Index of the lowest set bit of a non-zero word (de Bruijn multiplication)
+unsigned lowest_set_bit(std::uint64_t word)
+{
+    static unsigned const positions[64] = {
+        0, 1, 48, 2, 57, 49, 28, 3, 61, 58, 50, 42, 38, 29, 17, 4,
+        62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12, 5,
+        63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+        46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19, 9, 13, 8, 7, 6};
+    return positions[((word & -word) * 0x03f79d71b4cb0a89ULL) >> 58];
+}
+
+bool test_bit(std::vector<std::uint64_t> const& bits, unsigned index)
+{
+    return (bits[index / 64] >> (index % 64)) & 1;
+}
+
+void set_bit(std::vector<std::uint64_t>& bits, unsigned index)
+{
+    bits[index / 64] |= std::uint64_t(1) << (index % 64);
+}
+
 // Modify the code below to implement the functionality of the class.
 // Also remove comments from the parameter names when you implement
 // an operation (Commenting out parameter name prevents compiler from
 // warning about unused parameters on operations you haven't yet implemented.)
 
 Datastructures::Datastructures()
-    : places_(), areas_(), ways_(), crossroads_()
+    : places_(), ways_(), crossroads_(), area_indices_(), areas_()
 {
     // Replace this comment with your implementation
 }
@@ -46,7 +472,28 @@ int Datastructures::place_count()
 void Datastructures::clear_all()
 {
     places_.clear();
+    area_indices_.clear();
     areas_.clear();
+    area_parent_.clear();
+    area_first_child_.clear();
+    area_next_sibling_.clear();
+    area_prev_sibling_.clear();
+    free_area_indices_.clear();
+    area_lct_.clear();
+    area_infos_.clear();
+    area_twice_sizes_.clear();
+    area_subtree_boxes_dirty_ = true;
+    area_in_rtree_.clear();
+    area_rtree_pending_.clear();
+    area_rtrees_.clear();
+    area_rtree_size_ = 0;
+    place_areas_.clear();
+    area_places_.clear();
+    place_coords_.clear();
+    area_place_counts_.clear();
+    place_areas_dirty_ = true;
+    area_place_counts_dirty_ = true;
+    mark_area_hierarchy_changed();
 }
 
 std::vector<PlaceID> Datastructures::all_places()
@@ -64,6 +511,11 @@ bool Datastructures::add_place(PlaceID id, const Name& name, PlaceType type, Coo
     if (places_.find(id) == places_.end()) {
         Place place_to_add = { id, name, type, xy };
         places_[id] = std::make_shared<Place>(place_to_add);
+        place_coords_.insert({xy, id});
+        if (!place_areas_dirty_)
+        {
+            assign_place(id, xy);
+        }
         return true;
     }
 
@@ -90,9 +542,38 @@ Coord Datastructures::get_place_coord(PlaceID id)
 
 bool Datastructures::add_area(AreaID id, const Name &name, std::vector<Coord> coords)
 {
-    if (areas_.find(id) == areas_.end()) {
-        Area area_to_Add = { id, name, coords, nullptr, {} };
-        areas_[id] = std::make_shared<Area>(area_to_Add);
+    if (area_indices_.find(id) == area_indices_.end()) {
+        unsigned index = areas_.size();
+        long long twice_size = 0;
+        AreaInfo info = summarize_polygon(coords, twice_size);
+        if (!free_area_indices_.empty())
+        {
+            index = free_area_indices_.back();
+            free_area_indices_.pop_back();
+            areas_[index] = { id, name, std::move(coords) };
+            area_infos_[index] = info;
+            area_twice_sizes_[index] = twice_size;
+        }
+        else
+        {
+            areas_.push_back({ id, name, std::move(coords) });
+            area_parent_.push_back(NO_INDEX);
+            area_first_child_.push_back(NO_INDEX);
+            area_next_sibling_.push_back(NO_INDEX);
+            area_prev_sibling_.push_back(NO_INDEX);
+            area_lct_.push_back({});
+            area_infos_.push_back(info);
+            area_twice_sizes_.push_back(twice_size);
+            area_in_rtree_.push_back(false);
+            area_places_.push_back({});
+        }
+        area_indices_[id] = index;
+        area_rtree_pending_.push_back(index);
+        mark_area_hierarchy_changed();
+        if (!place_areas_dirty_)
+        {
+            assign_places_to_new_area(index);
+        }
         return true;
     }
 
@@ -101,27 +582,30 @@ bool Datastructures::add_area(AreaID id, const Name &name, std::vector<Coord> co
 
 Name Datastructures::get_area_name(AreaID id)
 {
-    if (areas_.find(id) != areas_.end())
+    unsigned index = find_area_index(id);
+    if (index != NO_INDEX)
     {
-        return areas_[id]->name;
+        return areas_[index].name;
     }
     return NO_NAME;
 }
 
 std::vector<Coord> Datastructures::get_area_coords(AreaID id)
 {
-    if (areas_.find(id) != areas_.end())
+    unsigned index = find_area_index(id);
+    if (index != NO_INDEX)
     {
-        return areas_[id]->coords;
+        return areas_[index].coords;
     }
     return {NO_COORD};
 }
 
 void Datastructures::creation_finished()
 {
-    // Replace this comment with your implementation
-    // NOTE!! It's quite ok to leave this empty, if you don't need operations
-    // that are performed after all additions have been done.
+    if (area_index_dirty_)
+    {
+        build_area_index();
+    }
 }
 
 
@@ -194,6 +678,13 @@ bool Datastructures::change_place_coord(PlaceID id, Coord newcoord)
 {
     if(places_.find(id) != places_.end())
     {
+        place_coords_.erase({places_[id]->coord, id});
+        place_coords_.insert({newcoord, id});
+        if (!place_areas_dirty_)
+        {
+            unassign_place(id);
+            assign_place(id, newcoord);
+        }
         places_[id]->coord = newcoord;
         return true;
     }
@@ -204,42 +695,45 @@ bool Datastructures::change_place_coord(PlaceID id, Coord newcoord)
 std::vector<AreaID> Datastructures::all_areas()
 {
     std::vector<AreaID> area_ids;
-    for (auto i : areas_) {
-        area_ids.push_back(i.first);
+    for (auto const& area : areas_)
+    {
+        if (area.id != NO_AREA)
+        {
+            area_ids.push_back(area.id);
+        }
     }
     return area_ids;
 }
 
 bool Datastructures::add_subarea_to_area(AreaID id, AreaID parentid)
 {
-    if (areas_.find(id) != areas_.end()
-            && areas_.find(parentid) != areas_.end()
-            && areas_[id]->parent == nullptr)
+    unsigned index = find_area_index(id);
+    unsigned parent = find_area_index(parentid);
+    if (index == NO_INDEX
+            || parent == NO_INDEX
+            || area_parent_[index] != NO_INDEX
+            || is_area_in_subtree(parent, index)) // Would make a cycle
     {
-        areas_[id]->parent = areas_[parentid];
-        areas_[parentid]->subareas.push_back(areas_[id]);
-        return true;
+        return false;
     }
-    return false;
+
+    link_area(index, parent);
+    return true;
 }
 
 std::vector<AreaID> Datastructures::subarea_in_areas(AreaID id)
 {
-    if (areas_.find(id) != areas_.end())
+    unsigned index = find_area_index(id);
+    if (index != NO_INDEX)
     {
         std::vector<AreaID> area_ids;
-        std::vector<std::shared_ptr<Area>> parents = find_parent_areas_recursive(areas_[id]);
-        for (auto i : parents)
-        {
-            area_ids.push_back(i->id);
-        }
+        walk_area_ancestors(index, [this, &area_ids](unsigned a) { area_ids.push_back(areas_[a].id); return true; });
 
         return area_ids;
     }
 
     return {NO_AREA};
 }
-
 std::vector<PlaceID> Datastructures::places_closest_to(Coord xy, PlaceType type)
 {
     std::vector<PlaceID> nearest_ids;
@@ -264,6 +758,11 @@ bool Datastructures::remove_place(PlaceID id)
 {
     if (places_.find(id) != places_.end())
     {
+        place_coords_.erase({places_[id]->coord, id});
+        if (!place_areas_dirty_)
+        {
+            unassign_place(id);
+        }
         places_.erase(id);
         return true;
     }
@@ -272,223 +771,3347 @@ bool Datastructures::remove_place(PlaceID id)
 
 std::vector<AreaID> Datastructures::all_subareas_in_area(AreaID id)
 {
-    if (areas_.find(id) != areas_.end())
+    unsigned index = find_area_index(id);
+    if (index != NO_INDEX)
     {
         std::vector<AreaID> area_ids;
-        std::vector<std::shared_ptr<Area>> subareas = find_subareas_recursive(areas_[id]);
-        for (auto i : subareas)
+        if (!use_area_index())
         {
-            area_ids.push_back(i->id);
+            // Listing one subtree doesn't justify rebuilding the whole index
+            walk_area_bfs(index, area_walk_, [this, index, &area_ids](unsigned a)
+            {
+                if (a != index) { area_ids.push_back(areas_[a].id); }
+            });
+            return area_ids;
         }
+
+        area_ids.reserve(area_preorder_end_[index] - area_preorder_begin_[index] - 1);
+        std::transform(preorder_areas_.begin() + area_preorder_begin_[index] + 1,
+                       preorder_areas_.begin() + area_preorder_end_[index],
+                       std::back_inserter(area_ids),
+                       [this](unsigned a) -> AreaID { return areas_[a].id; });
         return area_ids;
     }
     return {NO_AREA};
 }
 
-AreaID Datastructures::common_area_of_subareas(AreaID id1, AreaID id2)
+bool Datastructures::is_subarea_of(AreaID id, AreaID parentid)
 {
-    if (areas_.find(id1) != areas_.end()
-            && areas_.find(id2) != areas_.end()
-            && areas_[id1]->parent != nullptr
-            && areas_[id2]->parent != nullptr)
+    unsigned index = find_area_index(id);
+    unsigned parent = find_area_index(parentid);
+    if (index == NO_INDEX || parent == NO_INDEX || index == parent)
     {
-        std::vector<std::shared_ptr<Area>> parents = find_parent_areas_recursive(areas_[id1]);
-        return find_common_parent_recursive(parents, areas_[id2]);
+        return false;
     }
 
-    return NO_AREA;
+    return is_area_in_subtree(index, parent);
 }
 
-std::vector<std::shared_ptr<Place>> Datastructures::get_place_vector()
+AreaID Datastructures::common_area_of_subareas(AreaID id1, AreaID id2)
 {
-    std::vector<std::shared_ptr<Place>> place_vector;
-    for (auto elem : places_)
+    unsigned index1 = find_area_index(id1);
+    unsigned index2 = find_area_index(id2);
+    if (index1 != NO_INDEX
+            && index2 != NO_INDEX
+            && area_parent_[index1] != NO_INDEX
+            && area_parent_[index2] != NO_INDEX)
     {
-        place_vector.push_back(elem.second);
+        unsigned parent1 = area_parent_[index1];
+        unsigned parent2 = area_parent_[index2];
+        unsigned common = use_area_index() ? find_lowest_common_area(parent1, parent2)
+                                           : lct_lowest_common(parent1, parent2);
+        if (common != NO_INDEX)
+        {
+            return areas_[common].id;
+        }
     }
-    return place_vector;
-}
 
-std::vector<std::shared_ptr<Area>> Datastructures::find_parent_areas_recursive(std::shared_ptr<Area> area)
-{
-    std::vector<std::shared_ptr<Area>> areas = {};
-    if (area->parent != nullptr) {
-        areas.push_back(area->parent);
-        std::vector<std::shared_ptr<Area>> parents = find_parent_areas_recursive(area->parent);
-        areas.insert(areas.end(), parents.begin(), parents.end());
-    }
-    return areas;
+    return NO_AREA;
 }
 
-std::vector<std::shared_ptr<Area>> Datastructures::find_subareas_recursive(std::shared_ptr<Area> area)
+AreaID Datastructures::common_area_of_many(std::vector<AreaID> const& ids)
 {
-    std::vector<std::shared_ptr<Area>> areas = {};
-    if (!area->subareas.empty())
+    std::vector<unsigned> parents;
+    parents.reserve(ids.size());
+    for (AreaID id : ids)
     {
-        areas.insert(areas.end(), area->subareas.begin(), area->subareas.end());
-        for (auto i : area->subareas)
+        unsigned index = find_area_index(id);
+        if (index == NO_INDEX || area_parent_[index] == NO_INDEX)
         {
-            std::vector<std::shared_ptr<Area>> subareas = find_subareas_recursive(i);
-            areas.insert(areas.end(), subareas.begin(), subareas.end());
+            return NO_AREA;
         }
+        parents.push_back(area_parent_[index]);
     }
 
-    return areas;
-}
-
-AreaID Datastructures::find_common_parent_recursive(std::vector<std::shared_ptr<Area>> &parents, std::shared_ptr<Area> area)
-{
-    if (area->parent == nullptr)
+    if (parents.empty())
     {
         return NO_AREA;
     }
-    if (std::find(parents.begin(), parents.end(), area->parent) != parents.end())
+
+    if (!use_area_index())
+    {
+        unsigned common = parents.front();
+        for (unsigned i = 1; i < parents.size() && common != NO_INDEX; ++i)
+        {
+            common = lct_lowest_common(common, parents[i]);
+        }
+        return common != NO_INDEX ? areas_[common].id : NO_AREA;
+    }
+
+    // Threads fold their own chunks, a chunk spanning two trees settles the result
+    std::vector<unsigned> partial(parallel_chunks(parents.size(), 4096), NO_INDEX);
+    parallel_for(parents.size(), 4096, [this, &parents, &partial](unsigned chunk, unsigned begin, unsigned end)
+    {
+        unsigned common = parents[begin];
+        for (unsigned i = begin + 1; i < end && common != NO_INDEX; ++i)
+        {
+            common = find_lowest_common_area(common, parents[i]);
+        }
+        partial[chunk] = common;
+    });
+
+    unsigned common = partial.front();
+    for (unsigned i = 1; i < partial.size() && common != NO_INDEX; ++i)
     {
-        return area->parent->id;
+        common = partial[i] != NO_INDEX ? find_lowest_common_area(common, partial[i]) : NO_INDEX;
     }
-    return find_common_parent_recursive(parents, area->parent);
+
+    return common != NO_INDEX ? areas_[common].id : NO_AREA;
 }
 
-// really ugly -> do smth to this
-std::vector<std::shared_ptr<Place>> Datastructures::find_nearest_brute_force(Coord xy, PlaceType type)
+std::vector<std::vector<AreaID>> Datastructures::subarea_in_areas_batch(std::vector<AreaID> const& ids)
 {
-    std::vector<std::pair<unsigned, std::shared_ptr<Place>>> nearest;
-    unsigned highest_dist;
+    // Each distinct area is walked only once, repeated queries share its walk
+    std::vector<unsigned> walks;
+    std::vector<unsigned> query_walks(ids.size());
+    std::unordered_map<AreaID, unsigned> id_walks;
+    for (unsigned i = 0; i < ids.size(); ++i)
+    {
+        auto inserted = id_walks.insert({ids[i], walks.size()});
+        if (inserted.second)
+        {
+            walks.push_back(i);
+        }
+        query_walks[i] = inserted.first->second;
+    }
 
-    for (auto i : places_)
+    // A walk stops at an area an earlier walk passed and links to the rest of it
+    std::vector<unsigned> indices(walks.size());
+    std::vector<AreaID> walk_ids;
+    std::vector<unsigned> walk_begins(walks.size() + 1, 0);
+    std::vector<unsigned> link_walks(walks.size(), NO_INDEX);
+    std::vector<unsigned> link_positions(walks.size(), 0);
+    std::vector<unsigned> lengths(walks.size(), 0);
+    std::unordered_map<unsigned, std::pair<unsigned, unsigned>> reached; // area -> (walk, position)
+    for (unsigned w = 0; w < walks.size(); ++w)
     {
-        unsigned dist = calculate_coord_distance(xy, i.second->coord);
-        if(nearest.size() < 3 && (type == PlaceType::NO_TYPE || type == i.second->type))
+        indices[w] = find_area_index(ids[walks[w]]);
+        walk_begins[w] = walk_ids.size();
+        if (indices[w] == NO_INDEX)
         {
-            if (!highest_dist || dist > highest_dist)
+            walk_begins[w + 1] = walk_ids.size();
+            continue;
+        }
+
+        unsigned parent = area_parent_[indices[w]];
+        auto link = reached.end();
+        for ( ; parent != NO_INDEX; parent = area_parent_[parent])
+        {
+            auto inserted = reached.insert({parent, {w, static_cast<unsigned>(walk_ids.size()) - walk_begins[w]}});
+            if (!inserted.second)
             {
-                highest_dist = dist;
+                link = inserted.first;
+                break;
             }
-            nearest.push_back(std::make_pair(dist, i.second));
+            walk_ids.push_back(areas_[parent].id);
         }
-        else if (type == PlaceType::NO_TYPE || type == i.second->type)
+        walk_begins[w + 1] = walk_ids.size();
+        lengths[w] = walk_begins[w + 1] - walk_begins[w];
+        if (link != reached.end())
         {
-            if (dist <= highest_dist)
+            link_walks[w] = link->second.first;
+            link_positions[w] = link->second.second;
+            lengths[w] += lengths[link_walks[w]] - link_positions[w];
+        }
+    }
+
+    // Results are put together from the walked pieces in parallel
+    std::vector<std::vector<AreaID>> result(ids.size());
+    parallel_for(ids.size(), 256, [&query_walks, &indices, &lengths, &walk_ids, &walk_begins, &link_walks,
+                                   &link_positions, &result](unsigned, unsigned begin, unsigned end)
+    {
+        for (unsigned i = begin; i < end; ++i)
+        {
+            unsigned w = query_walks[i];
+            auto& parents = result[i];
+            if (indices[w] == NO_INDEX)
             {
-                auto it = std::find_if(nearest.begin(), nearest.end(),
-                                       [highest_dist](const std::pair<unsigned, std::shared_ptr<Place>> p)
-                                       { return p.first == highest_dist; });
+                parents = {NO_AREA};
+                continue;
+            }
 
-                if (it != nearest.end()
+            parents.reserve(lengths[w]);
+            parents.insert(parents.end(), walk_ids.begin() + walk_begins[w], walk_ids.begin() + walk_begins[w + 1]);
+            for (unsigned link = link_walks[w], position = link_positions[w]; link != NO_INDEX;
+                 position = link_positions[link], link = link_walks[link])
+            {
+                parents.insert(parents.end(), walk_ids.begin() + walk_begins[link] + position,
+                               walk_ids.begin() + walk_begins[link + 1]);
+            }
+        }
+    });
+
+    return result;
+}
+
+bool Datastructures::remove_area(AreaID id)
+{
+    unsigned index = find_area_index(id);
+    if (index == NO_INDEX)
+    {
+        return false;
+    }
+
+    // Subareas of the removed area become subareas of its parent
+    unsigned parent = area_parent_[index];
+    while (area_first_child_[index] != NO_INDEX)
+    {
+        unsigned sub = area_first_child_[index];
+        unlink_area(sub);
+        if (parent != NO_INDEX)
+        {
+            link_area(sub, parent);
+        }
+    }
+    if (parent != NO_INDEX)
+    {
+        unlink_area(index);
+    }
+
+    area_indices_.erase(id);
+    areas_[index] = {};
+    area_lct_[index] = {};
+    free_area_indices_.push_back(index);
+    mark_area_hierarchy_changed();
+    if (!place_areas_dirty_)
+    {
+        reassign_places_of_removed_area(index);
+    }
+    area_infos_[index] = {};
+    area_twice_sizes_[index] = 0;
+    area_in_rtree_[index] = false;
+    area_rtree_pending_.erase(std::remove(area_rtree_pending_.begin(), area_rtree_pending_.end(), index),
+                              area_rtree_pending_.end());
+    return true;
+}
+
+bool Datastructures::move_subarea(AreaID id, AreaID parentid)
+{
+    unsigned index = find_area_index(id);
+    unsigned parent = find_area_index(parentid);
+    if (index == NO_INDEX
+            || parent == NO_INDEX
+            || is_area_in_subtree(parent, index)) // Would make a cycle
+    {
+        return false;
+    }
+
+    if (area_parent_[index] != parent)
+    {
+        if (area_parent_[index] != NO_INDEX)
+        {
+            unlink_area(index);
+        }
+        link_area(index, parent);
+    }
+    return true;
+}
+
+int Datastructures::subarea_count(AreaID id)
+{
+    unsigned index = find_area_index(id);
+    if (index == NO_INDEX)
+    {
+        return NO_VALUE;
+    }
+
+    if (use_area_index())
+    {
+        return area_preorder_end_[index] - area_preorder_begin_[index] - 1;
+    }
+
+    // After access all subareas are in the virtual subtrees
+    lct_access(index);
+    return area_lct_[index].virtual_size;
+}
+
+AreaID Datastructures::area_of_place(PlaceID id)
+{
+    if (places_.find(id) == places_.end())
+    {
+        return NO_AREA;
+    }
+
+    if (place_areas_dirty_)
+    {
+        assign_all_places();
+    }
+    auto it = place_areas_.find(id);
+    return it != place_areas_.end() ? areas_[it->second.area].id : NO_AREA;
+}
+
+std::vector<PlaceID> Datastructures::places_in_area(AreaID id, bool recursive)
+{
+    unsigned index = find_area_index(id);
+    if (index == NO_INDEX)
+    {
+        return {NO_PLACE};
+    }
+
+    if (place_areas_dirty_)
+    {
+        assign_all_places();
+    }
+    if (!recursive)
+    {
+        return area_places_[index];
+    }
+
+    std::vector<PlaceID> place_ids;
+    auto append = [this, &place_ids](unsigned a)
+    {
+        place_ids.insert(place_ids.end(), area_places_[a].begin(), area_places_[a].end());
+    };
+    if (use_area_index())
+    {
+        std::for_each(preorder_areas_.begin() + area_preorder_begin_[index],
+                      preorder_areas_.begin() + area_preorder_end_[index], append);
+    }
+    else
+    {
+        walk_area_bfs(index, area_walk_, append);
+    }
+    return place_ids;
+}
+
+int Datastructures::place_count_in_area(AreaID id)
+{
+    unsigned index = find_area_index(id);
+    if (index == NO_INDEX)
+    {
+        return NO_VALUE;
+    }
+
+    if (place_areas_dirty_)
+    {
+        assign_all_places();
+    }
+    if (!use_area_index())
+    {
+        unsigned count = 0;
+        walk_area_bfs(index, area_walk_, [this, &count](unsigned a) { count += area_places_[a].size(); });
+        return count;
+    }
+
+    if (area_place_counts_dirty_)
+    {
+        // Linear time Fenwick tree construction: each node adds itself to its parent
+        unsigned count = preorder_areas_.size();
+        area_place_counts_.assign(count + 1, 0);
+        for (unsigned i = 1; i <= count; ++i)
+        {
+            area_place_counts_[i] += area_places_[preorder_areas_[i - 1]].size();
+            unsigned parent = i + (i & (~i + 1));
+            if (parent <= count)
+            {
+                area_place_counts_[parent] += area_place_counts_[i];
+            }
+        }
+        area_place_counts_dirty_ = false;
+    }
+
+    return count_places_before(area_preorder_end_[index]) - count_places_before(area_preorder_begin_[index]);
+}
+
+AreaInfo Datastructures::area_info(AreaID id)
+{
+    unsigned index = find_area_index(id);
+    if (index == NO_INDEX)
+    {
+        return NO_AREA_INFO;
+    }
+
+    if (area_subtree_boxes_dirty_)
+    {
+        build_area_subtree_boxes();
+    }
+    return area_infos_[index];
+}
+
+std::vector<AreaID> Datastructures::areas_in_rect(BoundingBox const& rect)
+{
+    update_area_rtree();
+
+    std::vector<AreaID> area_ids;
+    query_areas_in_box(rect, [this, &rect, &area_ids](unsigned area)
+    {
+        if (is_area_in_rect(area, rect))
+        {
+            area_ids.push_back(areas_[area].id);
+        }
+    });
+    return area_ids;
+}
+
+std::vector<AreaID> Datastructures::areas_in_rect(BoundingBox const& rect, AreaID root)
+{
+    unsigned index = find_area_index(root);
+    if (index == NO_INDEX)
+    {
+        return {NO_AREA};
+    }
+    if (area_subtree_boxes_dirty_)
+    {
+        build_area_subtree_boxes();
+    }
+
+    // A subtree whose box misses the rectangle is skipped as a whole
+    std::vector<AreaID> area_ids;
+    std::vector<unsigned> stk = {index};
+    while (!stk.empty())
+    {
+        unsigned area = stk.back();
+        stk.pop_back();
+        if (!boxes_intersect(area_infos_[area].subtree_box, rect))
+        {
+            continue;
+        }
+
+        if (boxes_intersect(area_infos_[area].box, rect) && is_area_in_rect(area, rect))
+        {
+            area_ids.push_back(areas_[area].id);
+        }
+        for (unsigned sub = area_first_child_[area]; sub != NO_INDEX; sub = area_next_sibling_[sub])
+        {
+            stk.push_back(sub);
+        }
+    }
+    return area_ids;
+}
+
+std::vector<std::pair<AreaID, AreaID>> Datastructures::overlapping_areas()
+{
+    if (!area_rtree_pending_.empty())
+    {
+        build_area_rtree();
+    }
+    if (area_index_dirty_)
+    {
+        build_area_index();
+    }
+
+    // Threads check their own chunks of areas, each pair from its smaller index
+    std::vector<std::vector<std::pair<AreaID, AreaID>>> found(worker_count());
+    parallel_for(areas_.size(), 64, [this, &found](unsigned chunk, unsigned begin, unsigned end)
+    {
+        for (unsigned area = begin; area < end; ++area)
+        {
+            if (areas_[area].id == NO_AREA || area_twice_sizes_[area] == 0)
+            {
+                continue;
+            }
+
+            auto const& info = area_infos_[area];
+            query_areas_in_box(info.box, [this, area, &info, &found, chunk](unsigned other)
+            {
+                if (other <= area || area_twice_sizes_[other] == 0)
+                {
+                    return;
+                }
+
+                // Subareas are expected to overlap their areas
+                auto nested = [this](unsigned a, unsigned root)
+                {
+                    return area_preorder_begin_[root] <= area_preorder_begin_[a]
+                            && area_preorder_end_[a] <= area_preorder_end_[root];
+                };
+                if (nested(area, other) || nested(other, area))
+                {
+                    return;
+                }
+
+                if (polygons_overlap(areas_[area].coords, info.box, areas_[other].coords, area_infos_[other].box))
+                {
+                    found[chunk].push_back({std::min(areas_[area].id, areas_[other].id),
+                                            std::max(areas_[area].id, areas_[other].id)});
+                }
+            });
+        }
+    });
+
+    std::vector<std::pair<AreaID, AreaID>> pairs;
+    for (auto const& chunk_pairs : found)
+    {
+        pairs.insert(pairs.end(), chunk_pairs.begin(), chunk_pairs.end());
+    }
+    std::sort(pairs.begin(), pairs.end());
+    return pairs;
+}
+
+std::vector<std::shared_ptr<Place>> Datastructures::get_place_vector()
+{
+    std::vector<std::shared_ptr<Place>> place_vector;
+    for (auto elem : places_)
+    {
+        place_vector.push_back(elem.second);
+    }
+    return place_vector;
+}
+
+unsigned Datastructures::find_area_index(AreaID id)
+{
+    auto it = area_indices_.find(id);
+    if (it != area_indices_.end())
+    {
+        return it->second;
+    }
+    return NO_INDEX;
+}
+
+void Datastructures::link_area(unsigned area, unsigned parent)
+{
+    area_parent_[area] = parent;
+    area_prev_sibling_[area] = NO_INDEX;
+    area_next_sibling_[area] = area_first_child_[parent];
+    if (area_first_child_[parent] != NO_INDEX)
+    {
+        area_prev_sibling_[area_first_child_[parent]] = area;
+    }
+    area_first_child_[parent] = area;
+
+    lct_link(area, parent);
+    mark_area_hierarchy_changed();
+}
+
+void Datastructures::unlink_area(unsigned area)
+{
+    unsigned prev = area_prev_sibling_[area];
+    unsigned next = area_next_sibling_[area];
+    if (prev != NO_INDEX)
+    {
+        area_next_sibling_[prev] = next;
+    }
+    else
+    {
+        area_first_child_[area_parent_[area]] = next;
+    }
+    if (next != NO_INDEX)
+    {
+        area_prev_sibling_[next] = prev;
+    }
+    area_parent_[area] = NO_INDEX;
+    area_prev_sibling_[area] = NO_INDEX;
+    area_next_sibling_[area] = NO_INDEX;
+
+    lct_cut(area);
+    mark_area_hierarchy_changed();
+}
+
+void Datastructures::mark_area_hierarchy_changed()
+{
+    area_index_dirty_ = true;
+    area_subtree_boxes_dirty_ = true;
+    area_queries_since_change_ = 0;
+}
+
+bool Datastructures::use_area_index()
+{
+    // Link-cut tree until enough queries have paid for an O(nlogn) index rebuild
+    if (area_index_dirty_ && ++area_queries_since_change_ >= areas_.size())
+    {
+        build_area_index();
+    }
+    return !area_index_dirty_;
+}
+
+bool Datastructures::is_area_in_subtree(unsigned area, unsigned root)
+{
+    if (area == root)
+    {
+        return true;
+    }
+    if (area_first_child_[root] == NO_INDEX)
+    {
+        return false;
+    }
+
+    if (use_area_index())
+    {
+        return area_preorder_begin_[root] < area_preorder_begin_[area]
+                && area_preorder_end_[area] <= area_preorder_end_[root];
+    }
+    return lct_lowest_common(area, root) == root;
+}
+
+void Datastructures::build_area_index()
+{
+    unsigned count = areas_.size();
+    area_roots_.assign(count, NO_INDEX);
+    area_euler_index_.assign(count, 0);
+    area_preorder_begin_.assign(count, 0);
+    area_preorder_end_.assign(count, 0);
+    preorder_areas_.clear();
+    euler_tour_.clear();
+    euler_depths_.clear();
+
+    // An area is visited when entered and after each of its subareas
+    unsigned root = NO_INDEX;
+    auto enter = [this, &root](unsigned area, unsigned depth)
+    {
+        area_euler_index_[area] = euler_tour_.size();
+        area_roots_[area] = root;
+        area_preorder_begin_[area] = preorder_areas_.size();
+        preorder_areas_.push_back(area);
+        euler_tour_.push_back(area);
+        euler_depths_.push_back(depth);
+    };
+    auto leave = [this](unsigned area, unsigned depth)
+    {
+        area_preorder_end_[area] = preorder_areas_.size();
+        if (depth > 0)
+        {
+            euler_tour_.push_back(area_parent_[area]);
+            euler_depths_.push_back(depth - 1);
+        }
+    };
+
+    for (root = 0; root < count; ++root)
+    {
+        if (area_parent_[root] == NO_INDEX && areas_[root].id != NO_AREA)
+        {
+            walk_area_dfs(root, area_walk_, enter, leave);
+        }
+    }
+
+    unsigned size = euler_tour_.size();
+    euler_log_.assign(size + 1, 0);
+    for (unsigned i = 2; i <= size; ++i)
+    {
+        euler_log_[i] = euler_log_[i / 2] + 1;
+    }
+
+    // euler_sparse_[k][i] is the position of the shallowest visit in [i, i + 2^k)
+    euler_sparse_.assign(euler_log_[size] + 1, {});
+    euler_sparse_[0].resize(size);
+    for (unsigned i = 0; i < size; ++i)
+    {
+        euler_sparse_[0][i] = i;
+    }
+    for (unsigned k = 1; k < euler_sparse_.size(); ++k)
+    {
+        unsigned half = 1u << (k - 1);
+        euler_sparse_[k].resize(size - (1u << k) + 1);
+        for (unsigned i = 0; i < euler_sparse_[k].size(); ++i)
+        {
+            unsigned left = euler_sparse_[k-1][i];
+            unsigned right = euler_sparse_[k-1][i + half];
+            euler_sparse_[k][i] = euler_depths_[right] < euler_depths_[left] ? right : left;
+        }
+    }
+
+    area_index_dirty_ = false;
+    area_place_counts_dirty_ = true;
+}
+
+unsigned Datastructures::find_lowest_common_area(unsigned area1, unsigned area2) const
+{
+    if (area_roots_[area1] != area_roots_[area2])
+    {
+        return NO_INDEX;
+    }
+
+    unsigned first = std::min(area_euler_index_[area1], area_euler_index_[area2]);
+    unsigned last = std::max(area_euler_index_[area1], area_euler_index_[area2]);
+    unsigned k = euler_log_[last - first + 1];
+    unsigned left = euler_sparse_[k][first];
+    unsigned right = euler_sparse_[k][last - (1u << k) + 1];
+
+    return euler_tour_[euler_depths_[right] < euler_depths_[left] ? right : left];
+}
+
+bool Datastructures::lct_is_splay_root(unsigned node) const
+{
+    unsigned parent = area_lct_[node].parent;
+    return parent == NO_INDEX || (area_lct_[parent].left != node && area_lct_[parent].right != node);
+}
+
+unsigned Datastructures::lct_size(unsigned node) const
+{
+    return node != NO_INDEX ? area_lct_[node].size : 0;
+}
+
+void Datastructures::lct_update(unsigned node)
+{
+    LinkCutNode& n = area_lct_[node];
+    n.size = 1 + lct_size(n.left) + lct_size(n.right) + n.virtual_size;
+}
+
+void Datastructures::lct_rotate(unsigned node)
+{
+    unsigned parent = area_lct_[node].parent;
+    unsigned grandparent = area_lct_[parent].parent;
+    bool parent_was_root = lct_is_splay_root(parent);
+
+    if (area_lct_[parent].left == node)
+    {
+        unsigned moved = area_lct_[node].right;
+        area_lct_[parent].left = moved;
+        if (moved != NO_INDEX) { area_lct_[moved].parent = parent; }
+        area_lct_[node].right = parent;
+    }
+    else
+    {
+        unsigned moved = area_lct_[node].left;
+        area_lct_[parent].right = moved;
+        if (moved != NO_INDEX) { area_lct_[moved].parent = parent; }
+        area_lct_[node].left = parent;
+    }
+    area_lct_[parent].parent = node;
+    area_lct_[node].parent = grandparent;
+
+    // A path parent pointer stays as it is, only real children are replaced
+    if (!parent_was_root)
+    {
+        if (area_lct_[grandparent].left == parent) { area_lct_[grandparent].left = node; }
+        else { area_lct_[grandparent].right = node; }
+    }
+
+    lct_update(parent);
+    lct_update(node);
+}
+
+void Datastructures::lct_splay(unsigned node)
+{
+    while (!lct_is_splay_root(node))
+    {
+        unsigned parent = area_lct_[node].parent;
+        if (!lct_is_splay_root(parent))
+        {
+            unsigned grandparent = area_lct_[parent].parent;
+            bool zigzig = (area_lct_[grandparent].left == parent) == (area_lct_[parent].left == node);
+            lct_rotate(zigzig ? parent : node);
+        }
+        lct_rotate(node);
+    }
+}
+
+unsigned Datastructures::lct_access(unsigned node)
+{
+    // Returns the last join point, the lowest common ancestor after a previous access
+    unsigned last = NO_INDEX;
+    for (unsigned current = node; current != NO_INDEX; current = area_lct_[current].parent)
+    {
+        lct_splay(current);
+        LinkCutNode& n = area_lct_[current];
+        n.virtual_size += lct_size(n.right);
+        n.virtual_size -= lct_size(last);
+        n.right = last;
+        lct_update(current);
+        last = current;
+    }
+    lct_splay(node);
+    return last;
+}
+
+unsigned Datastructures::lct_find_root(unsigned node)
+{
+    lct_access(node);
+    while (area_lct_[node].left != NO_INDEX)
+    {
+        node = area_lct_[node].left;
+    }
+    lct_splay(node);
+    return node;
+}
+
+void Datastructures::lct_link(unsigned node, unsigned parent)
+{
+    // node is the root of its tree, so after access its size covers the tree
+    lct_access(node);
+    lct_access(parent);
+    area_lct_[node].parent = parent;
+    area_lct_[parent].virtual_size += area_lct_[node].size;
+    lct_update(parent);
+}
+
+void Datastructures::lct_cut(unsigned node)
+{
+    lct_access(node);
+    unsigned above = area_lct_[node].left;
+    if (above != NO_INDEX)
+    {
+        area_lct_[above].parent = NO_INDEX;
+        area_lct_[node].left = NO_INDEX;
+        lct_update(node);
+    }
+}
+
+unsigned Datastructures::lct_lowest_common(unsigned node1, unsigned node2)
+{
+    if (lct_find_root(node1) != lct_find_root(node2))
+    {
+        return NO_INDEX;
+    }
+    lct_access(node1);
+    return lct_access(node2);
+}
+
+unsigned Datastructures::euler_create(unsigned item, bool arc)
+{
+    EulerNode node;
+    node.item = item;
+    node.arc = arc;
+    node.crossroads = !arc;
+    if (free_euler_nodes_.empty())
+    {
+        euler_nodes_.push_back(node);
+        return euler_nodes_.size() - 1;
+    }
+    unsigned index = free_euler_nodes_.back();
+    free_euler_nodes_.pop_back();
+    euler_nodes_[index] = node;
+    return index;
+}
+
+void Datastructures::euler_destroy(unsigned node)
+{
+    euler_nodes_[node] = {};
+    free_euler_nodes_.push_back(node);
+}
+
+unsigned Datastructures::euler_crossroads(unsigned node) const
+{
+    return node != NO_INDEX ? euler_nodes_[node].crossroads : 0;
+}
+
+std::uint8_t Datastructures::euler_subtree_flags(unsigned node) const
+{
+    return node != NO_INDEX ? euler_nodes_[node].subtree_flags : 0;
+}
+
+void Datastructures::euler_update(unsigned node)
+{
+    EulerNode& n = euler_nodes_[node];
+    n.crossroads = !n.arc + euler_crossroads(n.left) + euler_crossroads(n.right);
+    n.subtree_flags = n.flags | euler_subtree_flags(n.left) | euler_subtree_flags(n.right);
+}
+
+void Datastructures::euler_rotate(unsigned node)
+{
+    unsigned parent = euler_nodes_[node].parent;
+    unsigned grandparent = euler_nodes_[parent].parent;
+
+    if (euler_nodes_[parent].left == node)
+    {
+        unsigned moved = euler_nodes_[node].right;
+        euler_nodes_[parent].left = moved;
+        if (moved != NO_INDEX) { euler_nodes_[moved].parent = parent; }
+        euler_nodes_[node].right = parent;
+    }
+    else
+    {
+        unsigned moved = euler_nodes_[node].left;
+        euler_nodes_[parent].right = moved;
+        if (moved != NO_INDEX) { euler_nodes_[moved].parent = parent; }
+        euler_nodes_[node].left = parent;
+    }
+    euler_nodes_[parent].parent = node;
+    euler_nodes_[node].parent = grandparent;
+    if (grandparent != NO_INDEX)
+    {
+        if (euler_nodes_[grandparent].left == parent) { euler_nodes_[grandparent].left = node; }
+        else { euler_nodes_[grandparent].right = node; }
+    }
+
+    // The node itself is updated once it reaches the top in euler_splay
+    euler_update(parent);
+}
+
+void Datastructures::euler_splay(unsigned node)
+{
+    while (euler_nodes_[node].parent != NO_INDEX)
+    {
+        unsigned parent = euler_nodes_[node].parent;
+        unsigned grandparent = euler_nodes_[parent].parent;
+        if (grandparent != NO_INDEX)
+        {
+            bool zigzig = (euler_nodes_[grandparent].left == parent) == (euler_nodes_[parent].left == node);
+            euler_rotate(zigzig ? parent : node);
+        }
+        euler_rotate(node);
+    }
+    euler_update(node);
+}
+
+unsigned Datastructures::euler_join(unsigned left, unsigned right)
+{
+    // Both are roots of their trees, or NO_INDEX for an empty tour
+    if (left == NO_INDEX)
+    {
+        return right;
+    }
+    if (right == NO_INDEX)
+    {
+        return left;
+    }
+
+    unsigned last = left;
+    while (euler_nodes_[last].right != NO_INDEX)
+    {
+        last = euler_nodes_[last].right;
+    }
+    euler_splay(last);
+    euler_nodes_[last].right = right;
+    euler_nodes_[right].parent = last;
+    euler_update(last);
+    return last;
+}
+
+unsigned Datastructures::euler_detach_left(unsigned node)
+{
+    // Splits the tour before the node and returns the root of the first part
+    euler_splay(node);
+    unsigned left = euler_nodes_[node].left;
+    if (left != NO_INDEX)
+    {
+        euler_nodes_[left].parent = NO_INDEX;
+        euler_nodes_[node].left = NO_INDEX;
+        euler_update(node);
+    }
+    return left;
+}
+
+unsigned Datastructures::euler_detach_right(unsigned node)
+{
+    // Splits the tour after the node and returns the root of the second part
+    euler_splay(node);
+    unsigned right = euler_nodes_[node].right;
+    if (right != NO_INDEX)
+    {
+        euler_nodes_[right].parent = NO_INDEX;
+        euler_nodes_[node].right = NO_INDEX;
+        euler_update(node);
+    }
+    return right;
+}
+
+unsigned Datastructures::euler_build(std::vector<unsigned> const& tour, unsigned begin, unsigned end)
+{
+    // Balanced splay tree of the nodes tour[begin, end), returns its root
+    if (begin == end)
+    {
+        return NO_INDEX;
+    }
+    unsigned middle = begin + (end - begin) / 2;
+    unsigned node = tour[middle];
+    unsigned left = euler_build(tour, begin, middle);
+    unsigned right = euler_build(tour, middle + 1, end);
+    euler_nodes_[node].left = left;
+    euler_nodes_[node].right = right;
+    if (left != NO_INDEX) { euler_nodes_[left].parent = node; }
+    if (right != NO_INDEX) { euler_nodes_[right].parent = node; }
+    euler_update(node);
+    return node;
+}
+
+unsigned Datastructures::euler_reroot(unsigned node)
+{
+    // Rerooting moves the part of the tour before the node to the end
+    unsigned before = euler_detach_left(node);
+    return euler_join(node, before);
+}
+
+bool Datastructures::euler_same_tree(unsigned node1, unsigned node2)
+{
+    if (node1 == node2)
+    {
+        return true;
+    }
+    euler_splay(node1);
+    unsigned root = node2;
+    while (euler_nodes_[root].parent != NO_INDEX)
+    {
+        root = euler_nodes_[root].parent;
+    }
+    euler_splay(node2);
+    return root == node1;
+}
+
+unsigned Datastructures::euler_find_flag(unsigned root, std::uint8_t flag) const
+{
+    // Descends towards the first node of the tour with the flag
+    if (!(euler_subtree_flags(root) & flag))
+    {
+        return NO_INDEX;
+    }
+    unsigned node = root;
+    while (true)
+    {
+        EulerNode const& n = euler_nodes_[node];
+        if (euler_subtree_flags(n.left) & flag)
+        {
+            node = n.left;
+        }
+        else if (n.flags & flag)
+        {
+            return node;
+        }
+        else
+        {
+            node = n.right;
+        }
+    }
+}
+
+void Datastructures::euler_set_flag(unsigned node, std::uint8_t flag, bool set)
+{
+    euler_splay(node);
+    if (set)
+    {
+        euler_nodes_[node].flags |= flag;
+    }
+    else
+    {
+        euler_nodes_[node].flags &= ~flag;
+    }
+    euler_update(node);
+}
+
+void Datastructures::clear_connectivity()
+{
+    euler_nodes_.clear();
+    free_euler_nodes_.clear();
+    connectivity_vertices_.clear();
+    free_connectivity_vertices_.clear();
+    connectivity_edge_ids_.clear();
+    connectivity_edges_.clear();
+    free_connectivity_edges_.clear();
+}
+
+unsigned Datastructures::add_connectivity_vertex()
+{
+    if (free_connectivity_vertices_.empty())
+    {
+        connectivity_vertices_.emplace_back();
+        return connectivity_vertices_.size() - 1;
+    }
+    unsigned vertex = free_connectivity_vertices_.back();
+    free_connectivity_vertices_.pop_back();
+    return vertex;
+}
+
+void Datastructures::remove_connectivity_vertex(unsigned vertex)
+{
+    // Called once no way meets the crossroad, so its tour nodes are alone
+    for (unsigned node : connectivity_vertices_[vertex].nodes)
+    {
+        if (node != NO_INDEX)
+        {
+            euler_destroy(node);
+        }
+    }
+    connectivity_vertices_[vertex] = {};
+    free_connectivity_vertices_.push_back(vertex);
+}
+
+unsigned Datastructures::level_node(unsigned vertex, unsigned level)
+{
+    auto& nodes = connectivity_vertices_[vertex].nodes;
+    if (nodes.size() <= level)
+    {
+        nodes.resize(level + 1, NO_INDEX);
+    }
+    if (nodes[level] == NO_INDEX)
+    {
+        unsigned node = euler_create(vertex, false);
+        connectivity_vertices_[vertex].nodes[level] = node;
+    }
+    return connectivity_vertices_[vertex].nodes[level];
+}
+
+void Datastructures::link_tree_edge(unsigned edge, unsigned level)
+{
+    // Tour of one end, arc to the other end, its tour and the arc back
+    unsigned node1 = level_node(connectivity_edges_[edge].ends[0], level);
+    unsigned node2 = level_node(connectivity_edges_[edge].ends[1], level);
+    unsigned arc1 = euler_create(edge, true);
+    unsigned arc2 = euler_create(edge, true);
+    if (connectivity_edges_[edge].level == level)
+    {
+        euler_nodes_[arc1].flags = LEVEL_TREE_EDGE;
+        euler_update(arc1);
+    }
+    auto& arcs = connectivity_edges_[edge].arcs;
+    if (arcs.size() < 2 * (level + 1))
+    {
+        arcs.resize(2 * (level + 1), NO_INDEX);
+    }
+    arcs[2 * level] = arc1;
+    arcs[2 * level + 1] = arc2;
+
+    unsigned tour1 = euler_reroot(node1);
+    unsigned tour2 = euler_reroot(node2);
+    euler_join(euler_join(euler_join(tour1, arc1), tour2), arc2);
+}
+
+void Datastructures::cut_tree_edge(unsigned edge, unsigned level)
+{
+    // The tour is A arc1 B arc2 C (or arcs swapped), B is one half and A C the other
+    unsigned arc1 = connectivity_edges_[edge].arcs[2 * level];
+    unsigned arc2 = connectivity_edges_[edge].arcs[2 * level + 1];
+    unsigned before = euler_detach_left(arc1);
+    unsigned after = euler_detach_right(arc1);
+    if (after != NO_INDEX && euler_same_tree(arc2, after))
+    {
+        euler_detach_left(arc2);
+        euler_join(before, euler_detach_right(arc2));
+    }
+    else
+    {
+        unsigned first = euler_detach_left(arc2);
+        euler_detach_right(arc2);
+        euler_join(first, after);
+    }
+    euler_destroy(arc1);
+    euler_destroy(arc2);
+    connectivity_edges_[edge].arcs[2 * level] = NO_INDEX;
+    connectivity_edges_[edge].arcs[2 * level + 1] = NO_INDEX;
+}
+
+void Datastructures::add_non_tree_edge(unsigned edge)
+{
+    unsigned level = connectivity_edges_[edge].level;
+    for (unsigned end = 0; end < 2; ++end)
+    {
+        unsigned vertex = connectivity_edges_[edge].ends[end];
+        auto& lists = connectivity_vertices_[vertex].non_tree_edges;
+        if (lists.size() <= level)
+        {
+            lists.resize(level + 1);
+        }
+        lists[level].push_back(edge);
+        connectivity_edges_[edge].positions[end] = lists[level].size() - 1;
+        if (lists[level].size() == 1)
+        {
+            euler_set_flag(level_node(vertex, level), LEVEL_NON_TREE_EDGES, true);
+        }
+    }
+}
+
+void Datastructures::remove_non_tree_edge(unsigned edge)
+{
+    unsigned level = connectivity_edges_[edge].level;
+    for (unsigned end = 0; end < 2; ++end)
+    {
+        unsigned vertex = connectivity_edges_[edge].ends[end];
+        auto& list = connectivity_vertices_[vertex].non_tree_edges[level];
+        unsigned moved = list.back();
+        unsigned position = connectivity_edges_[edge].positions[end];
+        list[position] = moved;
+        connectivity_edges_[moved].positions[connectivity_edges_[moved].ends[0] == vertex ? 0 : 1] = position;
+        list.pop_back();
+        if (list.empty())
+        {
+            euler_set_flag(connectivity_vertices_[vertex].nodes[level], LEVEL_NON_TREE_EDGES, false);
+        }
+    }
+}
+
+unsigned Datastructures::create_connectivity_edge(WayID const& id, unsigned vertex1, unsigned vertex2)
+{
+    unsigned edge = connectivity_edges_.size();
+    if (free_connectivity_edges_.empty())
+    {
+        connectivity_edges_.emplace_back();
+    }
+    else
+    {
+        edge = free_connectivity_edges_.back();
+        free_connectivity_edges_.pop_back();
+    }
+    connectivity_edge_ids_.emplace(id, edge);
+    connectivity_edges_[edge] = {};
+    connectivity_edges_[edge].ends[0] = vertex1;
+    connectivity_edges_[edge].ends[1] = vertex2;
+    return edge;
+}
+
+void Datastructures::insert_connectivity_edge(WayID const& id, unsigned vertex1, unsigned vertex2)
+{
+    // A new edge starts at level 0, in the forest if it joins two trees
+    unsigned edge = create_connectivity_edge(id, vertex1, vertex2);
+    connectivity_edges_[edge].tree = !vertices_connected(vertex1, vertex2);
+    if (connectivity_edges_[edge].tree)
+    {
+        link_tree_edge(edge, 0);
+    }
+    else
+    {
+        add_non_tree_edge(edge);
+    }
+}
+
+void Datastructures::build_connectivity_forest(std::vector<unsigned> const& edges)
+{
+    // The forest's tours are written by a DFS and built into balanced splay trees
+    unsigned vertex_count = connectivity_vertices_.size();
+    std::vector<unsigned> offsets(vertex_count + 1, 0);
+    for (unsigned edge : edges)
+    {
+        ++offsets[connectivity_edges_[edge].ends[0] + 1];
+        ++offsets[connectivity_edges_[edge].ends[1] + 1];
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    std::vector<unsigned> adjacent(offsets.back());
+    std::vector<unsigned> fill(offsets.begin(), offsets.end() - 1);
+    for (unsigned edge : edges)
+    {
+        adjacent[fill[connectivity_edges_[edge].ends[0]]++] = edge;
+        adjacent[fill[connectivity_edges_[edge].ends[1]]++] = edge;
+    }
+
+    std::vector<bool> visited(vertex_count, false);
+    std::vector<unsigned> tour;
+    std::vector<std::tuple<unsigned, unsigned, unsigned>> stack; // Vertex, next adjacency, edge from the parent
+    for (unsigned root = 0; root < vertex_count; ++root)
+    {
+        if (visited[root] || offsets[root] == offsets[root + 1])
+        {
+            continue;
+        }
+        visited[root] = true;
+        tour.clear();
+        tour.push_back(level_node(root, 0));
+        stack.emplace_back(root, offsets[root], NO_INDEX);
+        while (!stack.empty())
+        {
+            auto [vertex, next, parent_edge] = stack.back();
+            if (next == offsets[vertex + 1])
+            {
+                stack.pop_back();
+                if (parent_edge != NO_INDEX)
+                {
+                    tour.push_back(connectivity_edges_[parent_edge].arcs[1]);
+                }
+                continue;
+            }
+            ++std::get<1>(stack.back());
+            unsigned edge = adjacent[next];
+            auto const& ends = connectivity_edges_[edge].ends;
+            unsigned child = ends[0] == vertex ? ends[1] : ends[0];
+            if (visited[child])
+            {
+                continue;
+            }
+            visited[child] = true;
+            unsigned arc1 = euler_create(edge, true);
+            unsigned arc2 = euler_create(edge, true);
+            euler_nodes_[arc1].flags = LEVEL_TREE_EDGE;
+            connectivity_edges_[edge].tree = true;
+            connectivity_edges_[edge].arcs = {arc1, arc2};
+            tour.push_back(arc1);
+            tour.push_back(level_node(child, 0));
+            stack.emplace_back(child, offsets[child], edge);
+        }
+        euler_build(tour, 0, tour.size());
+    }
+}
+
+void Datastructures::delete_connectivity_edge(WayID const& id)
+{
+    auto edge_id = connectivity_edge_ids_.find(id);
+    if (edge_id == connectivity_edge_ids_.end())
+    {
+        return;
+    }
+    unsigned edge = edge_id->second;
+    connectivity_edge_ids_.erase(edge_id);
+    free_connectivity_edges_.push_back(edge);
+    if (!connectivity_edges_[edge].tree)
+    {
+        remove_non_tree_edge(edge);
+        return;
+    }
+
+    // A replacement can only be at the cut edge's level or below
+    unsigned level = connectivity_edges_[edge].level;
+    unsigned vertex1 = connectivity_edges_[edge].ends[0];
+    unsigned vertex2 = connectivity_edges_[edge].ends[1];
+    for (unsigned forest = 0; forest <= level; ++forest)
+    {
+        cut_tree_edge(edge, forest);
+    }
+    for (unsigned forest = level + 1; forest-- > 0; )
+    {
+        if (find_replacement_edge(vertex1, vertex2, forest))
+        {
+            break;
+        }
+    }
+}
+
+bool Datastructures::find_replacement_edge(unsigned vertex1, unsigned vertex2, unsigned level)
+{
+    unsigned small = level_node(vertex1, level);
+    unsigned large = level_node(vertex2, level);
+    euler_splay(small);
+    euler_splay(large);
+    if (euler_nodes_[small].crossroads > euler_nodes_[large].crossroads)
+    {
+        std::swap(small, large);
+    }
+
+    // The smaller half fits in the next level, so its edges are raised there
+    while (true)
+    {
+        euler_splay(small);
+        unsigned arc = euler_find_flag(small, LEVEL_TREE_EDGE);
+        if (arc == NO_INDEX)
+        {
+            break;
+        }
+        unsigned edge = euler_nodes_[arc].item;
+        euler_set_flag(arc, LEVEL_TREE_EDGE, false);
+        connectivity_edges_[edge].level = level + 1;
+        link_tree_edge(edge, level + 1);
+    }
+
+    while (true)
+    {
+        euler_splay(small);
+        unsigned node = euler_find_flag(small, LEVEL_NON_TREE_EDGES);
+        if (node == NO_INDEX)
+        {
+            return false;
+        }
+        unsigned vertex = euler_nodes_[node].item;
+        while (!connectivity_vertices_[vertex].non_tree_edges[level].empty())
+        {
+            unsigned edge = connectivity_vertices_[vertex].non_tree_edges[level].back();
+            auto const& ends = connectivity_edges_[edge].ends;
+            unsigned other = ends[0] == vertex ? ends[1] : ends[0];
+            remove_non_tree_edge(edge);
+            if (!euler_same_tree(connectivity_vertices_[other].nodes[level], small))
+            {
+                // The edge reconnects the halves in this forest and below
+                connectivity_edges_[edge].tree = true;
+                for (unsigned forest = 0; forest <= level; ++forest)
+                {
+                    link_tree_edge(edge, forest);
+                }
+                return true;
+            }
+            connectivity_edges_[edge].level = level + 1;
+            add_non_tree_edge(edge);
+        }
+    }
+}
+
+bool Datastructures::vertices_connected(unsigned vertex1, unsigned vertex2)
+{
+    if (vertex1 == vertex2)
+    {
+        return true;
+    }
+    // A crossroad without a node in the spanning forest has no edges
+    auto const& nodes1 = connectivity_vertices_[vertex1].nodes;
+    auto const& nodes2 = connectivity_vertices_[vertex2].nodes;
+    if (nodes1.empty() || nodes2.empty() || nodes1[0] == NO_INDEX || nodes2[0] == NO_INDEX)
+    {
+        return false;
+    }
+    return euler_same_tree(nodes1[0], nodes2[0]);
+}
+
+Datastructures::AreaRTree Datastructures::pack_area_rtree(std::vector<unsigned> items) const
+{
+    // Sort-Tile-Recursive: x-sorted slices of about sqrt(leaves) leaves, each sorted by y
+    auto center_x = [this](unsigned a) { return static_cast<long long>(area_infos_[a].box.min.x) + area_infos_[a].box.max.x; };
+    auto center_y = [this](unsigned a) { return static_cast<long long>(area_infos_[a].box.min.y) + area_infos_[a].box.max.y; };
+    std::sort(items.begin(), items.end(),
+              [&center_x](unsigned a, unsigned b) { return center_x(a) < center_x(b); });
+    unsigned count = items.size();
+    unsigned leaves = (count + RTREE_FANOUT - 1) / RTREE_FANOUT;
+    unsigned slice = RTREE_FANOUT * static_cast<unsigned>(std::ceil(std::sqrt(leaves)));
+    for (unsigned begin = 0; begin < count; begin += slice)
+    {
+        std::sort(items.begin() + begin, items.begin() + std::min(begin + slice, count),
+                  [&center_y](unsigned a, unsigned b) { return center_y(a) < center_y(b); });
+    }
+
+    AreaRTree tree;
+    tree.min_size = std::numeric_limits<long long>::max();
+    tree.levels.assign(1, {});
+    for (unsigned area : items)
+    {
+        tree.min_size = std::min(tree.min_size, std::abs(area_twice_sizes_[area]));
+        tree.levels.front().push_back(area_infos_[area].box);
+    }
+    while (tree.levels.back().size() > 1)
+    {
+        std::vector<BoundingBox> level;
+        auto const& below = tree.levels.back();
+        for (unsigned first = 0; first < below.size(); first += RTREE_FANOUT)
+        {
+            BoundingBox box = below[first];
+            for (unsigned i = first + 1; i < std::min<unsigned>(first + RTREE_FANOUT, below.size()); ++i)
+            {
+                box = merge_boxes(box, below[i]);
+            }
+            level.push_back(box);
+        }
+        tree.levels.push_back(std::move(level));
+    }
+    tree.items = std::move(items);
+    return tree;
+}
+
+bool Datastructures::is_area_in_rect(unsigned area, BoundingBox const& rect) const
+{
+    // Areas whose box is inside the rectangle need no polygon test
+    BoundingBox const& box = area_infos_[area].box;
+    return (box_contains(rect, box.min) && box_contains(rect, box.max))
+            || polygon_intersects_box(areas_[area].coords, rect);
+}
+
+void Datastructures::build_area_subtree_boxes()
+{
+    // In postorder a subtree box is complete when merged into its parent's
+    auto enter = [this](unsigned area, unsigned)
+    {
+        area_infos_[area].subtree_box = area_infos_[area].box;
+    };
+    auto leave = [this](unsigned area, unsigned)
+    {
+        unsigned parent = area_parent_[area];
+        if (parent != NO_INDEX)
+        {
+            area_infos_[parent].subtree_box = merge_boxes(area_infos_[parent].subtree_box, area_infos_[area].subtree_box);
+        }
+    };
+
+    for (unsigned root = 0; root < areas_.size(); ++root)
+    {
+        if (area_parent_[root] == NO_INDEX && areas_[root].id != NO_AREA)
+        {
+            walk_area_dfs(root, area_walk_, enter, leave);
+        }
+    }
+    area_subtree_boxes_dirty_ = false;
+}
+
+void Datastructures::build_area_rtree()
+{
+    // Size class is the bit length of the absolute doubled size
+    std::vector<std::pair<unsigned, unsigned>> classes;
+    area_in_rtree_.assign(areas_.size(), false);
+    for (unsigned area = 0; area < areas_.size(); ++area)
+    {
+        if (areas_[area].id != NO_AREA && !areas_[area].coords.empty())
+        {
+            unsigned bits = 0;
+            for (auto size = static_cast<unsigned long long>(std::abs(area_twice_sizes_[area])); size > 0; size >>= 1)
+            {
+                ++bits;
+            }
+            classes.push_back({bits, area});
+            area_in_rtree_[area] = true;
+        }
+    }
+    std::sort(classes.begin(), classes.end());
+
+    area_rtree_pending_.clear();
+    area_rtrees_.clear();
+    area_rtree_size_ = classes.size();
+    for (unsigned begin = 0, end = 0; begin < classes.size(); begin = end)
+    {
+        std::vector<unsigned> items;
+        for (end = begin; end < classes.size() && classes[end].first == classes[begin].first; ++end)
+        {
+            items.push_back(classes[end].second);
+        }
+        area_rtrees_.push_back(pack_area_rtree(std::move(items)));
+    }
+}
+
+void Datastructures::update_area_rtree()
+{
+    // Rebuild once about sqrt(n) areas are pending
+    unsigned pending = area_rtree_pending_.size();
+    if (pending > RTREE_FANOUT && pending * pending > area_rtree_size_)
+    {
+        build_area_rtree();
+    }
+}
+
+bool Datastructures::is_inner_area(unsigned area, unsigned other) const
+{
+    // Of nested areas the inner one is smaller, ties are broken by id
+    if (other == NO_INDEX)
+    {
+        return true;
+    }
+    long long size = std::abs(area_twice_sizes_[area]);
+    long long other_size = std::abs(area_twice_sizes_[other]);
+    return size < other_size || (size == other_size && areas_[area].id < areas_[other].id);
+}
+
+unsigned Datastructures::find_innermost_area(Coord xy) const
+{
+    unsigned innermost = NO_INDEX;
+    auto visit = [this, xy, &innermost](unsigned area)
+    {
+        if (is_inner_area(area, innermost) && polygon_contains(areas_[area].coords, xy))
+        {
+            innermost = area;
+        }
+    };
+
+    for (unsigned area : area_rtree_pending_)
+    {
+        if (areas_[area].id != NO_AREA && box_contains(area_infos_[area].box, xy))
+        {
+            visit(area);
+        }
+    }
+    for (auto const& tree : area_rtrees_)
+    {
+        // Areas in the rest of the trees are all larger
+        if (innermost != NO_INDEX && std::abs(area_twice_sizes_[innermost]) < tree.min_size)
+        {
+            break;
+        }
+        query_area_rtree(tree, {xy, xy}, visit);
+    }
+    return innermost;
+}
+
+void Datastructures::assign_all_places()
+{
+    if (!area_rtree_pending_.empty())
+    {
+        build_area_rtree();
+    }
+
+    std::vector<std::pair<Coord, PlaceID>> places;
+    places.reserve(places_.size());
+    for (auto const& place : places_)
+    {
+        places.push_back({place.second->coord, place.first});
+    }
+
+    // Threads look up their own chunks in the read-only R-trees
+    std::vector<unsigned> innermost(places.size(), NO_INDEX);
+    parallel_for(places.size(), 1024, [this, &places, &innermost](unsigned, unsigned begin, unsigned end)
+    {
+        for (unsigned i = begin; i < end; ++i)
+        {
+            innermost[i] = find_innermost_area(places[i].first);
+        }
+    });
+
+    place_areas_.clear();
+    area_places_.assign(areas_.size(), {});
+    for (unsigned i = 0; i < places.size(); ++i)
+    {
+        if (innermost[i] != NO_INDEX)
+        {
+            auto& list = area_places_[innermost[i]];
+            place_areas_[places[i].second] = {innermost[i], static_cast<unsigned>(list.size())};
+            list.push_back(places[i].second);
+        }
+    }
+
+    place_areas_dirty_ = false;
+    area_place_counts_dirty_ = true;
+}
+
+void Datastructures::assign_place(PlaceID id, Coord xy)
+{
+    update_area_rtree();
+    set_place_area(id, find_innermost_area(xy));
+}
+
+void Datastructures::unassign_place(PlaceID id)
+{
+    set_place_area(id, NO_INDEX);
+}
+
+void Datastructures::assign_places_to_new_area(unsigned area)
+{
+    // Only places inside the new area can move, and only into it
+    for (auto const& [xy, id] : find_places_in_box(area_infos_[area].box))
+    {
+        auto it = place_areas_.find(id);
+        unsigned current = it != place_areas_.end() ? it->second.area : NO_INDEX;
+        if (is_inner_area(area, current) && polygon_contains(areas_[area].coords, xy))
+        {
+            set_place_area(id, area);
+        }
+    }
+}
+
+void Datastructures::reassign_places_of_removed_area(unsigned area)
+{
+    // The area is already removed, so lookups find the next innermost area
+    update_area_rtree();
+    std::vector<PlaceID> place_ids = area_places_[area];
+    for (PlaceID id : place_ids)
+    {
+        set_place_area(id, find_innermost_area(places_[id]->coord));
+    }
+}
+
+void Datastructures::set_place_area(PlaceID id, unsigned area)
+{
+    auto it = place_areas_.find(id);
+    if (it != place_areas_.end())
+    {
+        if (it->second.area == area)
+        {
+            return;
+        }
+
+        // Swap the last place of the list into the removed place's position
+        auto& list = area_places_[it->second.area];
+        list[it->second.position] = list.back();
+        place_areas_[list.back()].position = it->second.position;
+        list.pop_back();
+        add_area_place_count(it->second.area, -1);
+        place_areas_.erase(it);
+    }
+
+    if (area != NO_INDEX)
+    {
+        place_areas_[id] = {area, static_cast<unsigned>(area_places_[area].size())};
+        area_places_[area].push_back(id);
+        add_area_place_count(area, 1);
+    }
+}
+
+std::vector<std::pair<Coord, PlaceID>> Datastructures::find_places_in_box(BoundingBox const& box) const
+{
+    // The places in the box are in the band between its min and max y
+    std::vector<std::pair<Coord, PlaceID>> places;
+    if (box.min == NO_COORD)
+    {
+        return places;
+    }
+
+    auto it = place_coords_.lower_bound({{std::numeric_limits<int>::min(), box.min.y}, std::numeric_limits<PlaceID>::min()});
+    for (; it != place_coords_.end() && it->first.y <= box.max.y; ++it)
+    {
+        if (box.min.x <= it->first.x && it->first.x <= box.max.x)
+        {
+            places.push_back(*it);
+        }
+    }
+    return places;
+}
+
+void Datastructures::add_area_place_count(unsigned area, int delta)
+{
+    // Counts are by preorder position, so they are rebuilt with the area index
+    if (area_place_counts_dirty_ || area_index_dirty_)
+    {
+        area_place_counts_dirty_ = true;
+        return;
+    }
+
+    for (unsigned i = area_preorder_begin_[area] + 1; i < area_place_counts_.size(); i += i & (~i + 1))
+    {
+        area_place_counts_[i] += delta;
+    }
+}
+
+unsigned Datastructures::count_places_before(unsigned position) const
+{
+    unsigned count = 0;
+    for (unsigned i = position; i > 0; i -= i & (~i + 1))
+    {
+        count += area_place_counts_[i];
+    }
+    return count;
+}
+
+// really ugly -> do smth to this
+std::vector<std::shared_ptr<Place>> Datastructures::find_nearest_brute_force(Coord xy, PlaceType type)
+{
+    std::vector<std::pair<unsigned, std::shared_ptr<Place>>> nearest;
+    unsigned highest_dist;
+
+    for (auto i : places_)
+    {
+        unsigned dist = calculate_coord_distance(xy, i.second->coord);
+        if(nearest.size() < 3 && (type == PlaceType::NO_TYPE || type == i.second->type))
+        {
+            if (!highest_dist || dist > highest_dist)
+            {
+                highest_dist = dist;
+            }
+            nearest.push_back(std::make_pair(dist, i.second));
+        }
+        else if (type == PlaceType::NO_TYPE || type == i.second->type)
+        {
+            if (dist <= highest_dist)
+            {
+                auto it = std::find_if(nearest.begin(), nearest.end(),
+                                       [highest_dist](const std::pair<unsigned, std::shared_ptr<Place>> p)
+                                       { return p.first == highest_dist; });
+
+                if (it != nearest.end()
                         && (dist < highest_dist
                             || i.second->coord.y < it->second->coord.y))
                 {
-                    *it = std::make_pair(dist, i.second);
+                    *it = std::make_pair(dist, i.second);
+
+                    // calculate highest
+                    highest_dist = 0;
+                    for (auto near : nearest)
+                    {
+                        if (near.first > highest_dist)
+                        {
+                            highest_dist = near.first;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    std::vector<std::shared_ptr<Place>> result;
+    std::transform(nearest.begin(), nearest.end(), std::back_inserter(result),
+                   [](std::pair<unsigned, std::shared_ptr<Place>> const& p)
+            -> std::shared_ptr<Place>{ return p.second; });
+
+    return result;
+}
+
+unsigned Datastructures::calculate_coord_distance(Coord c1, Coord c2)
+{
+    return pow(c1.x - c2.x, 2) + pow(c1.y - c2.y, 2);
+}
+
+Distance Datastructures::calculate_way_length(std::vector<Coord> coords)
+{
+    unsigned len = 0;
+    for(unsigned i = 0; i < coords.size() - 1; i++)
+    {
+        len += sqrt(calculate_coord_distance(coords.at(i), coords.at(i+1)));
+    }
+
+    return (Distance)len;
+}
+
+void Datastructures::update_routing_graph()
+{
+    if (!graph_dirty_)
+    {
+        return;
+    }
+
+    graph_node_ids_.clear();
+    graph_coords_.clear();
+    graph_way_ids_.clear();
+    graph_node_ids_.reserve(crossroads_.size());
+    graph_coords_.reserve(crossroads_.size());
+    graph_way_ids_.reserve(ways_.size());
+    for (auto const& crossroad : crossroads_)
+    {
+        graph_node_ids_.emplace(crossroad.first, graph_coords_.size());
+        graph_coords_.push_back(crossroad.first);
+    }
+
+    std::unordered_map<WayID, unsigned> way_handles;
+    way_handles.reserve(ways_.size());
+    graph_offsets_.assign(graph_coords_.size() + 1, 0);
+    graph_min_stretch_ = 1;
+    graph_targets_.clear();
+    graph_ways_.clear();
+    graph_lengths_.clear();
+    for (unsigned node = 0; node < graph_coords_.size(); ++node)
+    {
+        Coord xy = graph_coords_[node];
+        for (auto const& [way_id, other] : crossroads_[xy].ways)
+        {
+            auto handle = way_handles.emplace(way_id, graph_way_ids_.size());
+            if (handle.second)
+            {
+                graph_way_ids_.push_back(way_id);
+            }
+            Distance length = ways_.at(way_id)->length;
+            graph_targets_.push_back(graph_node_ids_.at(other));
+            graph_ways_.push_back(handle.first->second);
+            graph_lengths_.push_back(length);
+            if (other != xy)
+            {
+                graph_min_stretch_ = std::min(graph_min_stretch_, length / straight_distance(xy, other));
+            }
+        }
+        graph_offsets_[node + 1] = graph_targets_.size();
+    }
+
+    graph_dirty_ = false;
+    contraction_ready_ = false;
+    landmarks_ready_ = false;
+}
+
+unsigned Datastructures::find_graph_node(Coord xy) const
+{
+    auto node = graph_node_ids_.find(xy);
+    if (node == graph_node_ids_.end())
+    {
+        return NO_INDEX;
+    }
+    return node->second;
+}
+
+unsigned Datastructures::edge_source(unsigned edge) const
+{
+    // The source is the node whose edge range contains the edge
+    auto next = std::upper_bound(graph_offsets_.begin(), graph_offsets_.end(), edge);
+    return next - graph_offsets_.begin() - 1;
+}
+
+std::vector<std::tuple<Coord, WayID, Distance>> Datastructures::make_route(unsigned from, unsigned to,
+                                                                           std::vector<unsigned> const& parent_edges) const
+{
+    // Collect the edges backwards from the destination
+    std::vector<unsigned> edges;
+    for (unsigned node = to; node != from; node = edge_source(parent_edges[node]))
+    {
+        edges.push_back(parent_edges[node]);
+    }
+
+    std::vector<std::tuple<Coord, WayID, Distance>> route;
+    route.reserve(edges.size() + 1);
+    Distance distance = 0;
+    unsigned node = from;
+    for (auto edge = edges.rbegin(); edge != edges.rend(); ++edge)
+    {
+        route.emplace_back(graph_coords_[node], graph_way_ids_[graph_ways_[*edge]], distance);
+        distance += graph_lengths_[*edge];
+        node = graph_targets_[*edge];
+    }
+    route.emplace_back(graph_coords_[to], NO_WAY, distance);
+    return route;
+}
+
+void Datastructures::prepare_route_algorithm(RouteAlgorithm algorithm)
+{
+    if (algorithm == RouteAlgorithm::LANDMARKS)
+    {
+        update_landmarks();
+    }
+    else if (algorithm == RouteAlgorithm::CONTRACTION && !contraction_ready_)
+    {
+        build_contraction_hierarchy();
+    }
+}
+
+std::vector<std::tuple<Coord, WayID, Distance>> Datastructures::find_route(unsigned from, unsigned to, RouteMetric metric,
+                                                                           RouteSearch& search) const
+{
+    switch (metric)
+    {
+    case RouteMetric::LEAST_CROSSROADS:
+        return bfs(from, to, search);
+    case RouteMetric::SHORTEST_DISTANCE:
+        return shortest_route(from, to, route_algorithm_, search);
+    default:
+        return dfs(from, to, search);
+    }
+}
+
+std::vector<std::tuple<Coord, WayID, Distance>> Datastructures::shortest_route(unsigned from, unsigned to,
+                                                                               RouteAlgorithm algorithm,
+                                                                               RouteSearch& search) const
+{
+    switch (algorithm)
+    {
+    case RouteAlgorithm::ASTAR:
+        return astar(from, to, false, search);
+    case RouteAlgorithm::LANDMARKS:
+        return astar(from, to, true, search);
+    case RouteAlgorithm::BIDIRECTIONAL:
+        return bidirectional_dijkstra(from, to, search);
+    case RouteAlgorithm::CONTRACTION:
+        return contraction_route(from, to, search);
+    default:
+        return dijkstra(from, to, search);
+    }
+}
+
+void Datastructures::RouteWorkspace::start(unsigned node_count)
+{
+    if (stamps.size() < node_count)
+    {
+        stamps.resize(node_count, 0);
+        target_stamps.resize(node_count, 0);
+        distances.resize(node_count);
+        parent_edges.resize(node_count);
+    }
+    expanded = 0;
+    ++stamp;
+    if (stamp == 0)
+    {
+        // The stamp wrapped around, so old stamps could look current
+        std::fill(stamps.begin(), stamps.end(), 0);
+        std::fill(target_stamps.begin(), target_stamps.end(), 0);
+        stamp = 1;
+    }
+    stack.clear();
+}
+
+void Datastructures::RouteWorkspace::reach(unsigned node, Distance distance, unsigned parent_edge)
+{
+    stamps[node] = stamp;
+    distances[node] = distance;
+    parent_edges[node] = parent_edge;
+}
+
+void Datastructures::RadixHeap::clear()
+{
+    for (auto& bucket : buckets)
+    {
+        bucket.clear();
+    }
+    last = 0;
+    size = 0;
+}
+
+void Datastructures::RadixHeap::push(Distance distance, unsigned node)
+{
+    unsigned bucket = 0;
+    for (unsigned bits = distance ^ last; bits != 0; bits >>= 1)
+    {
+        ++bucket;
+    }
+    buckets[bucket].emplace_back(distance, node);
+    ++size;
+}
+
+std::pair<Distance, unsigned> Datastructures::RadixHeap::top()
+{
+    if (buckets[0].empty())
+    {
+        unsigned bucket = 1;
+        while (buckets[bucket].empty())
+        {
+            ++bucket;
+        }
+
+        // The bucket's smallest distance becomes the last one, the rest move to lower buckets
+        auto entries = std::move(buckets[bucket]);
+        buckets[bucket].clear();
+        last = std::min_element(entries.begin(), entries.end())->first;
+        size -= entries.size();
+        for (auto const& entry : entries)
+        {
+            push(entry.first, entry.second);
+        }
+        entries.clear();
+        std::swap(buckets[bucket], entries); // Keep the capacity for reuse
+    }
+    return buckets[0].back();
+}
+
+std::pair<Distance, unsigned> Datastructures::RadixHeap::pop()
+{
+    auto entry = top();
+    buckets[0].pop_back();
+    --size;
+    return entry;
+}
+
+void Datastructures::IndexedHeap::clear(unsigned node_count)
+{
+    entries.clear();
+    if (positions.size() < node_count)
+    {
+        positions.resize(node_count);
+    }
+}
+
+void Datastructures::IndexedHeap::push_or_decrease(double priority, unsigned node, bool reached)
+{
+    if (reached && contains(node))
+    {
+        entries[positions[node]].first = priority;
+    }
+    else
+    {
+        positions[node] = entries.size();
+        entries.emplace_back(priority, node);
+    }
+    sift_up(positions[node]);
+}
+
+unsigned Datastructures::IndexedHeap::pop()
+{
+    unsigned node = entries.front().second;
+    positions[node] = NO_INDEX;
+    entries.front() = entries.back();
+    entries.pop_back();
+    if (!entries.empty())
+    {
+        positions[entries.front().second] = 0;
+        sift_down(0);
+    }
+    return node;
+}
+
+void Datastructures::IndexedHeap::sift_up(unsigned position)
+{
+    auto entry = entries[position];
+    while (position > 0)
+    {
+        unsigned parent = (position - 1) / 2;
+        if (!(entry < entries[parent]))
+        {
+            break;
+        }
+        entries[position] = entries[parent];
+        positions[entries[position].second] = position;
+        position = parent;
+    }
+    entries[position] = entry;
+    positions[entry.second] = position;
+}
+
+void Datastructures::DisjointSets::reset(unsigned count)
+{
+    parents.resize(count);
+    std::iota(parents.begin(), parents.end(), 0);
+    sizes.assign(count, 1);
+}
+
+unsigned Datastructures::DisjointSets::find(unsigned node)
+{
+    while (parents[node] != node)
+    {
+        parents[node] = parents[parents[node]];
+        node = parents[node];
+    }
+    return node;
+}
+
+bool Datastructures::DisjointSets::unite(unsigned node1, unsigned node2)
+{
+    node1 = find(node1);
+    node2 = find(node2);
+    if (node1 == node2)
+    {
+        return false;
+    }
+    if (sizes[node1] < sizes[node2])
+    {
+        std::swap(node1, node2);
+    }
+    parents[node2] = node1;
+    sizes[node1] += sizes[node2];
+    return true;
+}
+
+void Datastructures::IndexedHeap::sift_down(unsigned position)
+{
+    auto entry = entries[position];
+    while (true)
+    {
+        unsigned child = 2 * position + 1;
+        if (child >= entries.size())
+        {
+            break;
+        }
+        if (child + 1 < entries.size() && entries[child + 1] < entries[child])
+        {
+            ++child;
+        }
+        if (!(entries[child] < entry))
+        {
+            break;
+        }
+        entries[position] = entries[child];
+        positions[entries[position].second] = position;
+        position = child;
+    }
+    entries[position] = entry;
+    positions[entry.second] = position;
+}
+
+std::vector<std::tuple<Coord, WayID, Distance> > Datastructures::dfs(unsigned from, unsigned to, RouteSearch& search) const
+{
+    // Nodes are marked reached when pushed
+    auto& workspace = search.forward;
+    workspace.start(graph_coords_.size());
+    workspace.reach(from, 0, NO_INDEX);
+    workspace.stack.push_back(from);
+
+    while (!workspace.stack.empty())
+    {
+        unsigned node = workspace.stack.back();
+        workspace.stack.pop_back();
+        ++workspace.expanded;
+        if (node == to)
+        {
+            return make_route(from, to, workspace.parent_edges);
+        }
+
+        for (unsigned edge = graph_offsets_[node]; edge < graph_offsets_[node + 1]; ++edge)
+        {
+            unsigned target = graph_targets_[edge];
+            if (!workspace.reached(target))
+            {
+                workspace.reach(target, 0, edge);
+                workspace.stack.push_back(target);
+            }
+        }
+    }
+    return {};
+}
+
+std::vector<std::tuple<Coord, WayID, Distance>> Datastructures::bfs(unsigned from, unsigned to, RouteSearch& search) const
+{
+    unsigned node_count = graph_coords_.size();
+    unsigned words = (node_count + 63) / 64;
+    auto& workspace = search.forward;
+    workspace.start(node_count);
+    search.bfs_frontier.assign(words, 0);
+    search.bfs_next.assign(words, 0);
+    search.bfs_visited.assign(words, 0);
+    auto degree = [this](unsigned node) { return graph_offsets_[node + 1] - graph_offsets_[node]; };
+
+    workspace.reach(from, 0, NO_INDEX);
+    set_bit(search.bfs_visited, from);
+    set_bit(search.bfs_frontier, from);
+    unsigned frontier_size = 1;
+    unsigned long long frontier_edges = degree(from);
+    unsigned long long unvisited_edges = graph_targets_.size() - frontier_edges;
+    bool bottom_up = false;
+    for (unsigned level = 1; frontier_size > 0 && !test_bit(search.bfs_visited, to); ++level)
+    {
+        if (!bottom_up && frontier_edges > unvisited_edges / BFS_ALPHA)
+        {
+            bottom_up = true;
+        }
+        else if (bottom_up && frontier_size < node_count / BFS_BETA)
+        {
+            bottom_up = false;
+        }
+
+        std::fill(search.bfs_next.begin(), search.bfs_next.end(), 0);
+        if (bottom_up && search.parallel_bfs)
+        {
+            // Nodes only write their own words
+            parallel_for(words, 4096, [this, level, &search](unsigned, unsigned begin, unsigned end)
+            {
+                bfs_bottom_up(begin, end, level, search);
+            });
+        }
+        else if (bottom_up)
+        {
+            bfs_bottom_up(0, words, level, search);
+        }
+        else
+        {
+            // The first frontier node to reach a node has the smallest id
+            for (unsigned word = 0; word < words && !test_bit(search.bfs_visited, to); ++word)
+            {
+                for (std::uint64_t bits = search.bfs_frontier[word]; bits != 0 && !test_bit(search.bfs_visited, to); bits &= bits - 1)
+                {
+                    unsigned node = word * 64 + lowest_set_bit(bits);
+                    for (unsigned edge = graph_offsets_[node]; edge < graph_offsets_[node + 1]; ++edge)
+                    {
+                        unsigned target = graph_targets_[edge];
+                        if (!test_bit(search.bfs_visited, target))
+                        {
+                            workspace.reach(target, level, edge);
+                            set_bit(search.bfs_visited, target);
+                            set_bit(search.bfs_next, target);
+                        }
+                    }
+                }
+            }
+        }
+
+        std::swap(search.bfs_frontier, search.bfs_next);
+        frontier_size = 0;
+        frontier_edges = 0;
+        for (unsigned word = 0; word < words; ++word)
+        {
+            for (std::uint64_t bits = search.bfs_frontier[word]; bits != 0; bits &= bits - 1)
+            {
+                ++frontier_size;
+                frontier_edges += degree(word * 64 + lowest_set_bit(bits));
+            }
+        }
+        unvisited_edges -= std::min(unvisited_edges, frontier_edges);
+        workspace.expanded += frontier_size;
+    }
+
+    if (!test_bit(search.bfs_visited, to))
+    {
+        return {};
+    }
+    return make_route(from, to, workspace.parent_edges);
+}
+
+void Datastructures::bfs_bottom_up(unsigned begin_word, unsigned end_word, unsigned level, RouteSearch& search) const
+{
+    auto& workspace = search.forward;
+    unsigned node_count = graph_coords_.size();
+    for (unsigned word = begin_word; word < end_word; ++word)
+    {
+        for (std::uint64_t bits = ~search.bfs_visited[word]; bits != 0; bits &= bits - 1)
+        {
+            unsigned node = word * 64 + lowest_set_bit(bits);
+            if (node >= node_count)
+            {
+                break;
+            }
+
+            unsigned parent = NO_INDEX;
+            for (unsigned edge = graph_offsets_[node]; edge < graph_offsets_[node + 1]; ++edge)
+            {
+                unsigned neighbour = graph_targets_[edge];
+                if (neighbour < parent && test_bit(search.bfs_frontier, neighbour))
+                {
+                    parent = neighbour;
+                }
+            }
+            if (parent == NO_INDEX)
+            {
+                continue;
+            }
+
+            // The parent's first edge to the node, as top-down would pick it
+            unsigned edge = graph_offsets_[parent];
+            while (graph_targets_[edge] != node)
+            {
+                ++edge;
+            }
+            workspace.reach(node, level, edge);
+            set_bit(search.bfs_visited, node);
+            set_bit(search.bfs_next, node);
+        }
+    }
+}
+
+std::vector<std::tuple<Coord, WayID>> Datastructures::cycle_dfs(unsigned from, RouteSearch& search) const
+{
+    // An edge back to a gray node closes the cycle, the parent edge is skipped by way id
+    auto& workspace = search.forward;
+    auto& colours = search.colours;
+    auto& path = search.dfs_path;
+    workspace.start(graph_coords_.size());
+    if (colours.size() < graph_coords_.size())
+    {
+        colours.resize(graph_coords_.size());
+    }
+    path.clear();
+
+    workspace.reach(from, 0, NO_INDEX);
+    colours[from] = GRAY;
+    path.emplace_back(from, graph_offsets_[from]);
+    while (!path.empty())
+    {
+        auto& [node, edge] = path.back();
+        if (edge == graph_offsets_[node + 1])
+        {
+            colours[node] = BLACK;
+            path.pop_back();
+            continue;
+        }
+
+        unsigned current = edge++;
+        unsigned parent_edge = workspace.parent_edges[node];
+        if (parent_edge != NO_INDEX && graph_ways_[current] == graph_ways_[parent_edge])
+        {
+            continue;
+        }
+
+        unsigned target = graph_targets_[current];
+        if (!workspace.reached(target))
+        {
+            workspace.reach(target, 0, current);
+            colours[target] = GRAY;
+            path.emplace_back(target, graph_offsets_[target]);
+        }
+        else if (colours[target] == GRAY)
+        {
+            // Each node on the path left through the edge before its next one
+            std::vector<std::tuple<Coord, WayID>> route;
+            route.reserve(path.size() + 1);
+            for (auto [path_node, next_edge] : path)
+            {
+                route.emplace_back(graph_coords_[path_node], graph_way_ids_[graph_ways_[next_edge - 1]]);
+            }
+            route.emplace_back(graph_coords_[target], NO_WAY);
+            return route;
+        }
+    }
+    return {};
+}
+
+std::vector<std::tuple<Coord, WayID, Distance>> Datastructures::dijkstra(unsigned from, unsigned to, RouteSearch& search) const
+{
+    auto& workspace = search.forward;
+    auto& heap = search.forward_heap;
+    workspace.start(graph_coords_.size());
+    heap.clear();
+    workspace.reach(from, 0, NO_INDEX);
+    heap.push(0, from);
+
+    while (heap.size != 0)
+    {
+        auto [distance, node] = heap.pop();
+        if (distance > workspace.distances[node])
+        {
+            continue; // Stale entry, the node was settled with a shorter distance
+        }
+        ++workspace.expanded;
+        if (node == to)
+        {
+            return make_route(from, to, workspace.parent_edges);
+        }
+
+        for (unsigned edge = graph_offsets_[node]; edge < graph_offsets_[node + 1]; ++edge)
+        {
+            unsigned target = graph_targets_[edge];
+            Distance target_distance = distance + graph_lengths_[edge];
+            if (!workspace.reached(target) || target_distance < workspace.distances[target])
+            {
+                workspace.reach(target, target_distance, edge);
+                heap.push(target_distance, target);
+            }
+        }
+    }
+    return {};
+}
+
+Distance Datastructures::next_route_distance(RadixHeap& heap, RouteWorkspace const& workspace) const
+{
+    // Drop stale entries, so that the top of the heap is the next node to expand
+    while (heap.size != 0)
+    {
+        auto [distance, node] = heap.top();
+        if (distance <= workspace.distances[node])
+        {
+            return distance;
+        }
+        heap.pop();
+    }
+    return std::numeric_limits<Distance>::max();
+}
+
+void Datastructures::find_distances(unsigned from, std::vector<unsigned> const& targets, RouteWorkspace& workspace,
+                                    RadixHeap& heap) const
+{
+    // Stops once every target is settled, or runs to the end without targets
+    workspace.start(graph_coords_.size());
+    unsigned remaining = 0;
+    for (unsigned target : targets)
+    {
+        if (target != NO_INDEX && !workspace.is_target(target))
+        {
+            workspace.mark_target(target);
+            ++remaining;
+        }
+    }
+    if (!targets.empty() && remaining == 0)
+    {
+        return;
+    }
+
+    heap.clear();
+    workspace.reach(from, 0, NO_INDEX);
+    heap.push(0, from);
+    while (heap.size != 0)
+    {
+        auto [distance, node] = heap.pop();
+        if (distance > workspace.distances[node])
+        {
+            continue;
+        }
+        if (workspace.is_target(node) && --remaining == 0)
+        {
+            return;
+        }
+        for (unsigned edge = graph_offsets_[node]; edge < graph_offsets_[node + 1]; ++edge)
+        {
+            unsigned target = graph_targets_[edge];
+            Distance target_distance = distance + graph_lengths_[edge];
+            if (!workspace.reached(target) || target_distance < workspace.distances[target])
+            {
+                workspace.reach(target, target_distance, edge);
+                heap.push(target_distance, target);
+            }
+        }
+    }
+}
+
+std::vector<std::pair<Coord, Distance>> Datastructures::isochrone(unsigned from, Distance max_distance,
+                                                                  RouteSearch& search) const
+{
+    // Nodes beyond max_distance are never pushed, so settled nodes come in distance order
+    auto& workspace = search.forward;
+    auto& heap = search.forward_heap;
+    workspace.start(graph_coords_.size());
+    heap.clear();
+    std::vector<std::pair<Coord, Distance>> reached;
+    if (max_distance < 0)
+    {
+        return reached;
+    }
+
+    workspace.reach(from, 0, NO_INDEX);
+    heap.push(0, from);
+    while (heap.size != 0)
+    {
+        auto [distance, node] = heap.pop();
+        if (distance > workspace.distances[node])
+        {
+            continue;
+        }
+        ++workspace.expanded;
+        reached.emplace_back(graph_coords_[node], distance);
+
+        for (unsigned edge = graph_offsets_[node]; edge < graph_offsets_[node + 1]; ++edge)
+        {
+            // Compared before adding so that the sum can't overflow
+            unsigned target = graph_targets_[edge];
+            if (graph_lengths_[edge] > max_distance - distance)
+            {
+                continue;
+            }
+            Distance target_distance = distance + graph_lengths_[edge];
+            if (!workspace.reached(target) || target_distance < workspace.distances[target])
+            {
+                workspace.reach(target, target_distance, edge);
+                heap.push(target_distance, target);
+            }
+        }
+    }
+    return reached;
+}
+
+std::vector<std::tuple<Coord, WayID, Distance>> Datastructures::bidirectional_dijkstra(unsigned from, unsigned to,
+                                                                                       RouteSearch& search) const
+{
+    RouteWorkspace* workspaces[2] = {&search.forward, &search.backward};
+    RadixHeap* heaps[2] = {&search.forward_heap, &search.backward_heap};
+    unsigned starts[2] = {from, to};
+    for (unsigned side = 0; side < 2; ++side)
+    {
+        workspaces[side]->start(graph_coords_.size());
+        heaps[side]->clear();
+        workspaces[side]->reach(starts[side], 0, NO_INDEX);
+        heaps[side]->push(0, starts[side]);
+    }
+
+    // Grow the smaller frontier until no unexpanded node can beat the best meeting
+    Distance best = from == to ? 0 : std::numeric_limits<Distance>::max();
+    unsigned meeting = from == to ? from : NO_INDEX;
+    while (true)
+    {
+        Distance tops[2] = {next_route_distance(*heaps[0], *workspaces[0]),
+                            next_route_distance(*heaps[1], *workspaces[1])};
+        if (tops[0] == std::numeric_limits<Distance>::max() || tops[1] == std::numeric_limits<Distance>::max()
+                || tops[0] + tops[1] >= best)
+        {
+            break;
+        }
+
+        unsigned side = tops[0] <= tops[1] ? 0 : 1;
+        auto& workspace = *workspaces[side];
+        auto& other = *workspaces[1 - side];
+        auto [distance, node] = heaps[side]->pop();
+        ++workspace.expanded;
+        for (unsigned edge = graph_offsets_[node]; edge < graph_offsets_[node + 1]; ++edge)
+        {
+            unsigned target = graph_targets_[edge];
+            Distance target_distance = distance + graph_lengths_[edge];
+            if (!workspace.reached(target) || target_distance < workspace.distances[target])
+            {
+                workspace.reach(target, target_distance, edge);
+                heaps[side]->push(target_distance, target);
+            }
+            if (other.reached(target) && target_distance + other.distances[target] < best
+                    && workspace.distances[target] == target_distance)
+            {
+                best = target_distance + other.distances[target];
+                meeting = target;
+            }
+        }
+    }
+    search.forward.expanded += search.backward.expanded;
+
+    if (meeting == NO_INDEX)
+    {
+        return {};
+    }
+
+    // The backward parent edges lead from the meeting node to the destination
+    auto route = make_route(from, meeting, search.forward.parent_edges);
+    route.pop_back();
+    Distance distance = search.forward.distances[meeting];
+    for (unsigned node = meeting; node != to; )
+    {
+        unsigned edge = search.backward.parent_edges[node];
+        route.emplace_back(graph_coords_[node], graph_way_ids_[graph_ways_[edge]], distance);
+        distance += graph_lengths_[edge];
+        node = edge_source(edge);
+    }
+    route.emplace_back(graph_coords_[to], NO_WAY, distance);
+    return route;
+}
+
+void Datastructures::find_shortcuts(unsigned node, ContractionAdjacency const& adjacency, RouteWorkspace& workspace,
+                                    RadixHeap& heap, std::vector<std::pair<unsigned, unsigned>>& shortcuts) const
+{
+    // Witness searches from each neighbour avoid the node and stop at the longest route through it
+    shortcuts.clear();
+    auto const& neighbours = adjacency[node];
+    for (unsigned i = 0; i + 1 < neighbours.size(); ++i)
+    {
+        auto [source, source_arc] = neighbours[i];
+        Distance source_length = contraction_arcs_[source_arc].length;
+        Distance limit = 0;
+        for (unsigned j = i + 1; j < neighbours.size(); ++j)
+        {
+            limit = std::max(limit, source_length + contraction_arcs_[neighbours[j].second].length);
+        }
+
+        workspace.start(adjacency.size());
+        heap.clear();
+        unsigned targets = neighbours.size() - i - 1;
+        for (unsigned j = i + 1; j < neighbours.size(); ++j)
+        {
+            workspace.mark_target(neighbours[j].first);
+        }
+        workspace.reach(source, 0, NO_INDEX);
+        heap.push(0, source);
+        unsigned settled = 0;
+        while (settled < WITNESS_SETTLE_LIMIT && targets > 0)
+        {
+            Distance distance = next_route_distance(heap, workspace);
+            if (distance > limit)
+            {
+                break;
+            }
+            unsigned current = heap.pop().second;
+            ++settled;
+            if (workspace.is_target(current))
+            {
+                --targets;
+            }
+            for (auto [neighbour, arc] : adjacency[current])
+            {
+                Distance neighbour_distance = distance + contraction_arcs_[arc].length;
+                if (neighbour != node && neighbour_distance <= limit
+                        && (!workspace.reached(neighbour) || neighbour_distance < workspace.distances[neighbour]))
+                {
+                    workspace.reach(neighbour, neighbour_distance, arc);
+                    heap.push(neighbour_distance, neighbour);
+                }
+            }
+        }
 
-                    // calculate highest
-                    highest_dist = 0;
-                    for (auto near : nearest)
+        for (unsigned j = i + 1; j < neighbours.size(); ++j)
+        {
+            auto [target, target_arc] = neighbours[j];
+            Distance via = source_length + contraction_arcs_[target_arc].length;
+            if (!workspace.reached(target) || workspace.distances[target] > via)
+            {
+                shortcuts.emplace_back(source_arc, target_arc);
+            }
+        }
+    }
+}
+
+void Datastructures::build_contraction_hierarchy()
+{
+    unsigned node_count = graph_coords_.size();
+
+    // Original arcs, keeping only the shortest way between two crossroads
+    contraction_arcs_.clear();
+    ContractionAdjacency adjacency(node_count);
+    for (unsigned node = 0; node < node_count; ++node)
+    {
+        for (unsigned edge = graph_offsets_[node]; edge < graph_offsets_[node + 1]; ++edge)
+        {
+            unsigned target = graph_targets_[edge];
+            if (target <= node)
+            {
+                continue; // Each way is seen from both ends, loops don't matter
+            }
+            auto existing = std::find_if(adjacency[node].begin(), adjacency[node].end(),
+                                         [target](auto const& n) { return n.first == target; });
+            if (existing == adjacency[node].end())
+            {
+                adjacency[node].emplace_back(target, contraction_arcs_.size());
+                adjacency[target].emplace_back(node, contraction_arcs_.size());
+                contraction_arcs_.push_back({node, target, graph_lengths_[edge], graph_ways_[edge]});
+            }
+            else if (graph_lengths_[edge] < contraction_arcs_[existing->second].length)
+            {
+                contraction_arcs_[existing->second].length = graph_lengths_[edge];
+                contraction_arcs_[existing->second].way = graph_ways_[edge];
+            }
+        }
+    }
+
+    // Initial priorities: shortcuts added minus arcs removed by contraction
+    std::vector<int> priorities(node_count);
+    parallel_for(node_count, 1000, [this, &adjacency, &priorities](unsigned, unsigned begin, unsigned end)
+    {
+        RouteWorkspace workspace;
+        RadixHeap heap;
+        std::vector<std::pair<unsigned, unsigned>> shortcuts;
+        for (unsigned node = begin; node < end; ++node)
+        {
+            find_shortcuts(node, adjacency, workspace, heap, shortcuts);
+            priorities[node] = static_cast<int>(shortcuts.size()) - static_cast<int>(adjacency[node].size());
+        }
+    });
+
+    // Lazy updates: recompute the lowest priority before contracting its node
+    using Entry = std::pair<int, unsigned>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+    for (unsigned node = 0; node < node_count; ++node)
+    {
+        queue.emplace(priorities[node], node);
+    }
+    std::vector<unsigned> contracted_neighbours(node_count, 0);
+    std::vector<std::vector<unsigned>> up_arcs(node_count);
+    std::vector<unsigned> neighbour_slots(node_count, NO_INDEX);
+    std::vector<std::pair<unsigned, unsigned>> shortcuts;
+    RouteWorkspace& workspace = route_search_.forward;
+    RadixHeap& heap = route_search_.forward_heap;
+    while (!queue.empty())
+    {
+        unsigned node = queue.top().second;
+        queue.pop();
+        find_shortcuts(node, adjacency, workspace, heap, shortcuts);
+        int priority = static_cast<int>(shortcuts.size()) - static_cast<int>(adjacency[node].size())
+                + static_cast<int>(contracted_neighbours[node]);
+        if (!queue.empty() && priority > queue.top().first)
+        {
+            queue.emplace(priority, node);
+            continue;
+        }
+
+        for (auto [neighbour, arc] : adjacency[node])
+        {
+            up_arcs[node].push_back(arc);
+            auto& list = adjacency[neighbour];
+            list.erase(std::find_if(list.begin(), list.end(), [node](auto const& n) { return n.first == node; }));
+            ++contracted_neighbours[neighbour];
+        }
+        adjacency[node].clear();
+
+        // Shortcuts come grouped by source, whose neighbours are in neighbour_slots
+        unsigned slotted = NO_INDEX;
+        for (auto [first, second] : shortcuts)
+        {
+            unsigned source = contraction_arcs_[first].from == node ? contraction_arcs_[first].to : contraction_arcs_[first].from;
+            unsigned target = contraction_arcs_[second].from == node ? contraction_arcs_[second].to : contraction_arcs_[second].from;
+            if (source != slotted)
+            {
+                if (slotted != NO_INDEX)
+                {
+                    for (auto neighbour : adjacency[slotted])
                     {
-                        if (near.first > highest_dist)
-                        {
-                            highest_dist = near.first;
-                        }
+                        neighbour_slots[neighbour.first] = NO_INDEX;
+                    }
+                }
+                slotted = source;
+                for (unsigned slot = 0; slot < adjacency[source].size(); ++slot)
+                {
+                    neighbour_slots[adjacency[source][slot].first] = slot;
+                }
+            }
+
+            Distance length = contraction_arcs_[first].length + contraction_arcs_[second].length;
+            unsigned arc = contraction_arcs_.size();
+            unsigned slot = neighbour_slots[target];
+            if (slot == NO_INDEX)
+            {
+                neighbour_slots[target] = adjacency[source].size();
+                adjacency[source].emplace_back(target, arc);
+                adjacency[target].emplace_back(source, arc);
+            }
+            else if (length < contraction_arcs_[adjacency[source][slot].second].length)
+            {
+                adjacency[source][slot].second = arc;
+                std::find_if(adjacency[target].begin(), adjacency[target].end(),
+                             [source](auto const& n) { return n.first == source; })->second = arc;
+            }
+            else
+            {
+                continue;
+            }
+            contraction_arcs_.push_back({source, target, length, NO_INDEX, first, second});
+        }
+        if (slotted != NO_INDEX)
+        {
+            for (auto neighbour : adjacency[slotted])
+            {
+                neighbour_slots[neighbour.first] = NO_INDEX;
+            }
+        }
+    }
+
+    contraction_up_offsets_.assign(node_count + 1, 0);
+    contraction_up_arcs_.clear();
+    for (unsigned node = 0; node < node_count; ++node)
+    {
+        contraction_up_arcs_.insert(contraction_up_arcs_.end(), up_arcs[node].begin(), up_arcs[node].end());
+        contraction_up_offsets_[node + 1] = contraction_up_arcs_.size();
+    }
+    contraction_ready_ = true;
+}
+
+void Datastructures::unpack_contraction_arc(unsigned arc, unsigned from, std::vector<std::tuple<Coord, WayID, Distance>>& route,
+                                            Distance& distance) const
+{
+    // Stack of (arc, crossroad it is entered from), second half pushed first
+    std::vector<std::pair<unsigned, unsigned>> stack = {{arc, from}};
+    while (!stack.empty())
+    {
+        auto [current, node] = stack.back();
+        stack.pop_back();
+        auto const& a = contraction_arcs_[current];
+        if (a.way != NO_INDEX)
+        {
+            route.emplace_back(graph_coords_[node], graph_way_ids_[a.way], distance);
+            distance += a.length;
+            continue;
+        }
+
+        auto const& first = contraction_arcs_[a.first];
+        unsigned middle = first.from == a.from ? first.to : first.from;
+        if (node == a.from)
+        {
+            stack.emplace_back(a.second, middle);
+            stack.emplace_back(a.first, node);
+        }
+        else
+        {
+            stack.emplace_back(a.first, middle);
+            stack.emplace_back(a.second, node);
+        }
+    }
+}
+
+std::vector<std::tuple<Coord, WayID, Distance>> Datastructures::contraction_route(unsigned from, unsigned to,
+                                                                                  RouteSearch& search) const
+{
+    RouteWorkspace* workspaces[2] = {&search.forward, &search.backward};
+    RadixHeap* heaps[2] = {&search.forward_heap, &search.backward_heap};
+    unsigned starts[2] = {from, to};
+    for (unsigned side = 0; side < 2; ++side)
+    {
+        workspaces[side]->start(graph_coords_.size());
+        heaps[side]->clear();
+        workspaces[side]->reach(starts[side], 0, NO_INDEX);
+        heaps[side]->push(0, starts[side]);
+    }
+
+    // Both searches run until their next distance reaches the best meeting
+    Distance best = std::numeric_limits<Distance>::max();
+    unsigned meeting = NO_INDEX;
+    while (true)
+    {
+        Distance tops[2] = {next_route_distance(*heaps[0], *workspaces[0]),
+                            next_route_distance(*heaps[1], *workspaces[1])};
+        if (tops[0] >= best && tops[1] >= best)
+        {
+            break;
+        }
+
+        unsigned side = tops[0] <= tops[1] ? 0 : 1;
+        auto& workspace = *workspaces[side];
+        auto& other = *workspaces[1 - side];
+        auto [distance, node] = heaps[side]->pop();
+        ++workspace.expanded;
+        if (other.reached(node) && distance + other.distances[node] < best)
+        {
+            best = distance + other.distances[node];
+            meeting = node;
+        }
+
+        // Stall-on-demand: a higher reached crossroad gives a shorter distance here
+        bool stalled = false;
+        for (unsigned up = contraction_up_offsets_[node]; up < contraction_up_offsets_[node + 1] && !stalled; ++up)
+        {
+            auto const& a = contraction_arcs_[contraction_up_arcs_[up]];
+            unsigned target = a.from == node ? a.to : a.from;
+            stalled = workspace.reached(target) && workspace.distances[target] + a.length < distance;
+        }
+        if (stalled)
+        {
+            continue;
+        }
+
+        for (unsigned up = contraction_up_offsets_[node]; up < contraction_up_offsets_[node + 1]; ++up)
+        {
+            unsigned arc = contraction_up_arcs_[up];
+            auto const& a = contraction_arcs_[arc];
+            unsigned target = a.from == node ? a.to : a.from;
+            Distance target_distance = distance + a.length;
+            if (!workspace.reached(target) || target_distance < workspace.distances[target])
+            {
+                workspace.reach(target, target_distance, arc);
+                heaps[side]->push(target_distance, target);
+            }
+        }
+    }
+    search.forward.expanded += search.backward.expanded;
+
+    if (meeting == NO_INDEX)
+    {
+        return {};
+    }
+
+    // Arcs up to the meeting node and down to the destination
+    std::vector<std::pair<unsigned, unsigned>> arcs;
+    for (unsigned node = meeting; node != from; )
+    {
+        unsigned arc = search.forward.parent_edges[node];
+        node = contraction_arcs_[arc].from == node ? contraction_arcs_[arc].to : contraction_arcs_[arc].from;
+        arcs.emplace_back(arc, node);
+    }
+    std::reverse(arcs.begin(), arcs.end());
+    for (unsigned node = meeting; node != to; )
+    {
+        unsigned arc = search.backward.parent_edges[node];
+        arcs.emplace_back(arc, node);
+        node = contraction_arcs_[arc].from == node ? contraction_arcs_[arc].to : contraction_arcs_[arc].from;
+    }
+
+    std::vector<std::tuple<Coord, WayID, Distance>> route;
+    Distance distance = 0;
+    for (auto [arc, node] : arcs)
+    {
+        unpack_contraction_arc(arc, node, route, distance);
+    }
+    route.emplace_back(graph_coords_[to], NO_WAY, distance);
+    return route;
+}
+
+void Datastructures::search_upward(unsigned from, RouteWorkspace& workspace, RadixHeap& heap,
+                                   std::vector<unsigned>& settled) const
+{
+    // Upward search to the top of the hierarchy, stalled crossroads are left out
+    workspace.start(graph_coords_.size());
+    heap.clear();
+    settled.clear();
+    workspace.reach(from, 0, NO_INDEX);
+    heap.push(0, from);
+    while (heap.size != 0)
+    {
+        auto [distance, node] = heap.pop();
+        if (distance > workspace.distances[node])
+        {
+            continue;
+        }
+
+        bool stalled = false;
+        for (unsigned up = contraction_up_offsets_[node]; up < contraction_up_offsets_[node + 1] && !stalled; ++up)
+        {
+            auto const& a = contraction_arcs_[contraction_up_arcs_[up]];
+            unsigned target = a.from == node ? a.to : a.from;
+            stalled = workspace.reached(target) && workspace.distances[target] + a.length < distance;
+        }
+        if (stalled)
+        {
+            continue;
+        }
+        settled.push_back(node);
+
+        for (unsigned up = contraction_up_offsets_[node]; up < contraction_up_offsets_[node + 1]; ++up)
+        {
+            unsigned arc = contraction_up_arcs_[up];
+            auto const& a = contraction_arcs_[arc];
+            unsigned target = a.from == node ? a.to : a.from;
+            Distance target_distance = distance + a.length;
+            if (!workspace.reached(target) || target_distance < workspace.distances[target])
+            {
+                workspace.reach(target, target_distance, arc);
+                heap.push(target_distance, target);
+            }
+        }
+    }
+}
+
+std::vector<std::vector<Distance>> Datastructures::contraction_distance_matrix(std::vector<unsigned> const& sources,
+                                                                               std::vector<unsigned> const& targets) const
+{
+    // Target searches leave bucket entries that each source's upward search scans
+    std::vector<std::vector<std::tuple<unsigned, unsigned, Distance>>> chunk_entries(worker_count());
+    parallel_for(targets.size(), 16, [this, &targets, &chunk_entries](unsigned chunk, unsigned begin, unsigned end)
+    {
+        RouteWorkspace workspace;
+        RadixHeap heap;
+        std::vector<unsigned> settled;
+        for (unsigned target = begin; target < end; ++target)
+        {
+            if (targets[target] == NO_INDEX)
+            {
+                continue;
+            }
+            search_upward(targets[target], workspace, heap, settled);
+            for (unsigned node : settled)
+            {
+                chunk_entries[chunk].emplace_back(node, target, workspace.distances[node]);
+            }
+        }
+    });
+
+    // Buckets of all crossroads in one array, grouped by crossroad
+    std::vector<unsigned> bucket_offsets(graph_coords_.size() + 1, 0);
+    for (auto const& entries : chunk_entries)
+    {
+        for (auto const& entry : entries)
+        {
+            ++bucket_offsets[std::get<0>(entry) + 1];
+        }
+    }
+    std::partial_sum(bucket_offsets.begin(), bucket_offsets.end(), bucket_offsets.begin());
+    std::vector<std::pair<unsigned, Distance>> buckets(bucket_offsets.back());
+    auto bucket_ends = bucket_offsets;
+    for (auto const& entries : chunk_entries)
+    {
+        for (auto const& [node, target, distance] : entries)
+        {
+            buckets[bucket_ends[node]++] = {target, distance};
+        }
+    }
+
+    std::vector<std::vector<Distance>> matrix(sources.size(), std::vector<Distance>(targets.size(), NO_DISTANCE));
+    parallel_for(sources.size(), 16, [this, &sources, &bucket_offsets, &buckets, &matrix](unsigned, unsigned begin, unsigned end)
+    {
+        RouteWorkspace workspace;
+        RadixHeap heap;
+        std::vector<unsigned> settled;
+        for (unsigned source = begin; source < end; ++source)
+        {
+            if (sources[source] == NO_INDEX)
+            {
+                continue;
+            }
+            search_upward(sources[source], workspace, heap, settled);
+            auto& row = matrix[source];
+            for (unsigned node : settled)
+            {
+                for (unsigned entry = bucket_offsets[node]; entry < bucket_offsets[node + 1]; ++entry)
+                {
+                    auto [target, distance] = buckets[entry];
+                    Distance total = workspace.distances[node] + distance;
+                    if (row[target] == NO_DISTANCE || total < row[target])
+                    {
+                        row[target] = total;
                     }
                 }
             }
         }
+    });
+    return matrix;
+}
+
+std::vector<std::tuple<Coord, WayID, Distance>> Datastructures::astar(unsigned from, unsigned to, bool landmarks,
+                                                                      RouteSearch& search) const
+{
+    // Straight distance scaled by the smallest stretch, or the largest landmark bound
+    auto& workspace = search.forward;
+    auto& heap = search.indexed_heap;
+    workspace.start(graph_coords_.size());
+    heap.clear(graph_coords_.size());
+    Coord target_xy = graph_coords_[to];
+    unsigned landmark_count = landmarks ? landmark_coords_.size() : 0;
+    Distance const* target_distances = landmark_distances_.data() + std::size_t(to) * landmark_count;
+    Distance const* from_distances = landmark_distances_.data() + std::size_t(from) * landmark_count;
+    for (unsigned landmark = 0; landmark < landmark_count; ++landmark)
+    {
+        if ((from_distances[landmark] == NO_DISTANCE) != (target_distances[landmark] == NO_DISTANCE))
+        {
+            return {}; // Only one end is connected to the landmark
+        }
+    }
+    auto estimate = [this, target_xy, landmark_count, target_distances](unsigned node, Distance distance)
+    {
+        double bound = graph_min_stretch_ * straight_distance(graph_coords_[node], target_xy);
+        Distance const* node_distances = landmark_distances_.data() + std::size_t(node) * landmark_count;
+        for (unsigned landmark = 0; landmark < landmark_count; ++landmark)
+        {
+            if (node_distances[landmark] != NO_DISTANCE && target_distances[landmark] != NO_DISTANCE)
+            {
+                bound = std::max<double>(bound, std::abs(target_distances[landmark] - node_distances[landmark]));
+            }
+        }
+        return distance + bound;
+    };
+
+    workspace.reach(from, 0, NO_INDEX);
+    heap.push_or_decrease(estimate(from, 0), from, false);
+    while (!heap.entries.empty())
+    {
+        unsigned node = heap.pop();
+        ++workspace.expanded;
+        if (node == to)
+        {
+            return make_route(from, to, workspace.parent_edges);
+        }
+
+        Distance distance = workspace.distances[node];
+        for (unsigned edge = graph_offsets_[node]; edge < graph_offsets_[node + 1]; ++edge)
+        {
+            unsigned target = graph_targets_[edge];
+            Distance target_distance = distance + graph_lengths_[edge];
+            bool reached = workspace.reached(target);
+            if (!reached || target_distance < workspace.distances[target])
+            {
+                workspace.reach(target, target_distance, edge);
+                heap.push_or_decrease(estimate(target, target_distance), target, reached);
+            }
+        }
+    }
+    return {};
+}
+
+void Datastructures::select_landmarks()
+{
+    // Farthest-point selection by straight distance to the nearest landmark
+    landmark_coords_.clear();
+    unsigned node_count = graph_coords_.size();
+    std::vector<double> nearest(node_count, std::numeric_limits<double>::max());
+    unsigned next = 0;
+    for (unsigned node = 0; node < node_count; ++node)
+    {
+        if (straight_distance(graph_coords_[node], graph_coords_[0]) > straight_distance(graph_coords_[next], graph_coords_[0]))
+        {
+            next = node;
+        }
+    }
+    while (landmark_coords_.size() < std::min<std::size_t>(LANDMARK_COUNT, node_count))
+    {
+        Coord landmark = graph_coords_[next];
+        landmark_coords_.push_back(landmark);
+        // Chosen landmarks are at distance 0, so none is chosen twice
+        double farthest = 0;
+        for (unsigned node = 0; node < node_count; ++node)
+        {
+            nearest[node] = std::min(nearest[node], straight_distance(graph_coords_[node], landmark));
+            if (nearest[node] > farthest)
+            {
+                farthest = nearest[node];
+                next = node;
+            }
+        }
+    }
+}
+
+void Datastructures::update_landmarks()
+{
+    if (landmarks_ready_)
+    {
+        return;
+    }
+
+    // Landmarks are kept while their crossroads exist
+    bool reselect = landmark_coords_.size() < std::min<std::size_t>(LANDMARK_COUNT, graph_coords_.size());
+    std::vector<unsigned> landmarks;
+    for (Coord xy : landmark_coords_)
+    {
+        landmarks.push_back(find_graph_node(xy));
+        reselect = reselect || landmarks.back() == NO_INDEX;
+    }
+    if (reselect)
+    {
+        select_landmarks();
+        landmarks.clear();
+        for (Coord xy : landmark_coords_)
+        {
+            landmarks.push_back(find_graph_node(xy));
+        }
     }
 
-    std::vector<std::shared_ptr<Place>> result;
-    std::transform(nearest.begin(), nearest.end(), std::back_inserter(result),
-                   [](std::pair<unsigned, std::shared_ptr<Place>> const& p)
-            -> std::shared_ptr<Place>{ return p.second; });
-
-    return result;
+    unsigned landmark_count = landmarks.size();
+    landmark_distances_.assign(graph_coords_.size() * std::size_t(landmark_count), NO_DISTANCE);
+    parallel_for(landmark_count, 1, [this, &landmarks, landmark_count](unsigned, unsigned begin, unsigned end)
+    {
+        RouteWorkspace workspace;
+        RadixHeap heap;
+        for (unsigned landmark = begin; landmark < end; ++landmark)
+        {
+            find_distances(landmarks[landmark], {}, workspace, heap);
+            for (unsigned node = 0; node < graph_coords_.size(); ++node)
+            {
+                if (workspace.reached(node))
+                {
+                    landmark_distances_[std::size_t(node) * landmark_count + landmark] = workspace.distances[node];
+                }
+            }
+        }
+    });
+    landmarks_ready_ = true;
 }
 
-unsigned Datastructures::calculate_coord_distance(Coord c1, Coord c2)
+std::size_t Datastructures::RouteCacheKeyHash::operator()(RouteCacheKey const& key) const
 {
-    return pow(c1.x - c2.x, 2) + pow(c1.y - c2.y, 2);
+    CoordHash hasher;
+    auto fromhash = hasher(key.from);
+    auto tohash = hasher(key.to) + static_cast<std::size_t>(key.metric);
+    return fromhash ^ (tohash + 0x9e3779b9 + (fromhash << 6) + (fromhash >> 2));
 }
 
-Distance Datastructures::calculate_way_length(std::vector<Coord> coords)
+std::vector<std::tuple<Coord, WayID, Distance>> Datastructures::cached_route(Coord fromxy, Coord toxy, RouteMetric metric)
 {
-    unsigned len = 0;
-    for(unsigned i = 0; i < coords.size() - 1; i++)
+    if (crossroads_.find(fromxy) == crossroads_.end()
+            || crossroads_.find(toxy) == crossroads_.end())
     {
-        len += sqrt(calculate_coord_distance(coords.at(i), coords.at(i+1)));
+        return {{NO_COORD, NO_WAY, NO_DISTANCE}};
     }
 
-    return (Distance)len;
-}
+    RouteCacheKey key = {fromxy, toxy, metric};
+    auto cached = route_cache_.find(key);
+    if (cached != route_cache_.end())
+    {
+        ++route_cache_stats_.hits;
+        route_cache_lru_.splice(route_cache_lru_.begin(), route_cache_lru_, cached->second);
+        return cached->second->route;
+    }
 
-std::vector<std::tuple<Coord, WayID, Distance>> Datastructures::astar(Coord c1, Coord c2)
-{
-    return {};
+    ++route_cache_stats_.misses;
+    if (!connected(fromxy, toxy))
+    {
+        return {};
+    }
+    update_routing_graph();
+    if (metric == RouteMetric::SHORTEST_DISTANCE)
+    {
+        prepare_route_algorithm(route_algorithm_);
+    }
+    auto route = find_route(find_graph_node(fromxy), find_graph_node(toxy), metric, route_search_);
+    cache_route(key, route);
+    return route;
 }
 
-std::vector<std::tuple<Coord, WayID, Distance> > Datastructures::dfs(Coord c1, Coord c2)
+void Datastructures::cache_route(RouteCacheKey const& key, std::vector<std::tuple<Coord, WayID, Distance>> const& route)
 {
-    bool found = false;
-    std::stack<Coord> stk;
-    std::unordered_set<Coord, CoordHash> visited = {c1};
-    std::unordered_map<Coord, std::tuple<Coord, WayID>, CoordHash> parent_map;
-    stk.push(c1);
+    // Routes to the same crossroad are found in O(1) and aren't cached
+    std::size_t bytes = sizeof(RouteCacheEntry)
+            + route.size() * (sizeof(std::tuple<Coord, WayID, Distance>) + sizeof(RouteCacheKey));
+    if (key.from == key.to || bytes > ROUTE_CACHE_BUDGET)
+    {
+        return;
+    }
 
-    Coord current_coord;
+    while (route_cache_stats_.bytes + bytes > ROUTE_CACHE_BUDGET)
+    {
+        ++route_cache_stats_.evictions;
+        erase_cached_route(std::prev(route_cache_lru_.end()));
+    }
+    route_cache_lru_.push_front({key, route, bytes});
+    route_cache_.emplace(key, route_cache_lru_.begin());
+    index_cached_route(route_cache_lru_.front(), true);
+    route_cache_stats_.bytes += bytes;
+    for (auto const& step : route)
+    {
+        if (std::get<1>(step) != NO_WAY)
+        {
+            route_cache_ways_[std::get<1>(step)].insert(key);
+        }
+    }
+}
 
-    while (!stk.empty() && !found)
+std::list<Datastructures::RouteCacheEntry>::iterator Datastructures::erase_cached_route(std::list<RouteCacheEntry>::iterator entry)
+{
+    for (auto const& step : entry->route)
     {
-        current_coord = stk.top();
-        stk.pop();
-        if (current_coord == c2)
+        auto way = route_cache_ways_.find(std::get<1>(step));
+        if (way != route_cache_ways_.end())
         {
-            found = true;
-            break;
+            way->second.erase(entry->key);
+            if (way->second.empty())
+            {
+                route_cache_ways_.erase(way);
+            }
         }
+    }
+    index_cached_route(*entry, false);
+    route_cache_stats_.bytes -= entry->bytes;
+    route_cache_.erase(entry->key);
+    return route_cache_lru_.erase(entry);
+}
 
-        for (auto &way_id : crossroads_[current_coord])
+void Datastructures::index_cached_route(RouteCacheEntry const& entry, bool insert)
+{
+    auto const& key = entry.key;
+    auto const& route = entry.route;
+    if (route.empty() || (key.metric == RouteMetric::LEAST_CROSSROADS && route.size() > 4))
+    {
+        if (insert)
+        {
+            route_cache_always_stale_.insert(key);
+        }
+        else
         {
-            std::vector<Coord> coords = ways_[way_id]->coords;
-            if(visited.find(coords.front()) == visited.end())
+            route_cache_always_stale_.erase(key);
+        }
+    }
+    else if (key.metric == RouteMetric::LEAST_CROSSROADS && route.size() == 4)
+    {
+        for (Coord end : {key.from, key.to})
+        {
+            if (insert)
             {
-                stk.push(coords.front());
-                visited.insert(coords.front());
-                parent_map[coords.front()] = std::make_tuple(current_coord, way_id);
+                route_cache_three_way_ends_.insert({end, key.from, key.to});
             }
-            else if(visited.find(coords.back()) == visited.end())
+            else
+            {
+                route_cache_three_way_ends_.erase({end, key.from, key.to});
+            }
+        }
+    }
+    else if (key.metric == RouteMetric::SHORTEST_DISTANCE)
+    {
+        unsigned bits = 0;
+        for (Distance distance = std::get<2>(route.back()); distance > 0; distance >>= 1)
+        {
+            ++bits;
+        }
+        if (insert)
+        {
+            if (route_cache_shortest_.size() <= bits)
             {
-                stk.push(coords.back());
-                visited.insert(coords.back());
-                parent_map[coords.back()] = std::make_tuple(current_coord, way_id);
+                route_cache_shortest_.resize(bits + 1);
             }
+            route_cache_shortest_[bits].insert({key.from, key.to});
         }
+        else
+        {
+            route_cache_shortest_[bits].erase({key.from, key.to});
+        }
+    }
+}
+
+void Datastructures::invalidate_routes_after_add(Way const& way)
+{
+    // A loop shortens no route and connects nothing new
+    Coord end1 = way.coords.front();
+    Coord end2 = way.coords.back();
+    if (end1 == end2)
+    {
+        return;
     }
+    route_cache_min_stretch_ = std::min(route_cache_min_stretch_, way.length / straight_distance(end1, end2));
 
-    if (found)
+    std::vector<RouteCacheKey> stale(route_cache_always_stale_.begin(), route_cache_always_stale_.end());
+
+    // Only routes of two or three ways can be beaten by a way at their ends
+    for (RouteCacheKey key : {RouteCacheKey{end1, end2, RouteMetric::LEAST_CROSSROADS},
+                              RouteCacheKey{end2, end1, RouteMetric::LEAST_CROSSROADS}})
+    {
+        auto cached = route_cache_.find(key);
+        if (cached != route_cache_.end() && cached->second->route.size() == 3)
+        {
+            stale.push_back(key);
+        }
+    }
+    for (Coord end : {end1, end2})
     {
-        std::vector<std::tuple<Coord, WayID, Distance>> result;
-        std::vector<std::tuple<Coord, WayID>> route;
+        for (auto it = route_cache_three_way_ends_.lower_bound({end, NO_COORD, NO_COORD});
+             it != route_cache_three_way_ends_.end() && std::get<0>(*it) == end; ++it)
+        {
+            stale.push_back({std::get<1>(*it), std::get<2>(*it), RouteMetric::LEAST_CROSSROADS});
+        }
+    }
 
-        Coord current = c2;
-        while(current != c1)
+    // Only starts within (2^bits - 1 - length)/stretch of an end can be beaten
+    for (unsigned bits = 0; bits < route_cache_shortest_.size(); ++bits)
+    {
+        auto const& routes = route_cache_shortest_[bits];
+        double longest = std::ldexp(1.0, bits) - 1;
+        if (routes.empty() || longest <= way.length)
         {
-            route.push_back(std::make_tuple(current, std::get<1>(parent_map.at(current))));
-            current = std::get<0>(parent_map.at(current));
+            continue;
         }
-        route.push_back(std::make_tuple(c1, NO_WAY));
 
-        Distance tot_dist = 0;
-        for (auto it = route.rbegin(); it != route.rend(); ++it)
+        double radius = (longest - way.length) / route_cache_min_stretch_;
+        for (Coord end : {end1, end2})
         {
-            WayID id = std::get<1>(*it);
-            if (ways_.find(id) != ways_.end())
+            double min_y = std::max<double>(end.y - radius, std::numeric_limits<int>::min());
+            double max_y = std::min<double>(end.y + radius, std::numeric_limits<int>::max());
+            for (auto it = routes.lower_bound({Coord{NO_VALUE, static_cast<int>(std::ceil(min_y))}, NO_COORD});
+                 it != routes.end() && it->first.y <= max_y; ++it)
             {
-                tot_dist += ways_[id]->length;
+                auto [from, to] = *it;
+                if (std::abs(static_cast<double>(from.x) - end.x) > radius)
+                {
+                    continue;
+                }
+                double outside = std::min(straight_distance(from, end1) + straight_distance(end2, to),
+                                          straight_distance(from, end2) + straight_distance(end1, to));
+                RouteCacheKey key = {from, to, RouteMetric::SHORTEST_DISTANCE};
+                if (way.length + route_cache_min_stretch_ * outside < std::get<2>(route_cache_.at(key)->route.back()))
+                {
+                    stale.push_back(key);
+                }
             }
+        }
+    }
 
-            result.push_back(std::tuple_cat(*it, std::make_tuple(tot_dist)));
+    // A route can be found more than once
+    for (auto const& key : stale)
+    {
+        auto cached = route_cache_.find(key);
+        if (cached != route_cache_.end())
+        {
+            ++route_cache_stats_.invalidations;
+            erase_cached_route(cached->second);
         }
+    }
+}
+
+void Datastructures::invalidate_routes_using(WayID const& id)
+{
+    auto way = route_cache_ways_.find(id);
+    if (way == route_cache_ways_.end())
+    {
+        return;
+    }
 
-        return result;
+    auto keys = std::move(way->second);
+    route_cache_ways_.erase(way);
+    for (auto const& key : keys)
+    {
+        ++route_cache_stats_.invalidations;
+        erase_cached_route(route_cache_.at(key));
     }
-    return {};
+}
+
+void Datastructures::clear_route_cache()
+{
+    route_cache_lru_.clear();
+    route_cache_.clear();
+    route_cache_ways_.clear();
+    route_cache_shortest_.clear();
+    route_cache_three_way_ends_.clear();
+    route_cache_always_stale_.clear();
+    route_cache_stats_.bytes = 0;
+    route_cache_min_stretch_ = 1;
 }
 
 std::vector<WayID> Datastructures::all_ways()
@@ -510,24 +4133,25 @@ bool Datastructures::add_way(WayID id, std::vector<Coord> coords)
             calculate_way_length(coords)
         };
         ways_[id] = std::make_shared<Way>(way_to_add);
+        graph_dirty_ = true;
 
-        if(crossroads_.find(coords.front()) == crossroads_.end())
+        unsigned vertices[2];
+        for (unsigned end = 0; end < 2; ++end)
         {
-            crossroads_[coords.front()] = {id};
-        }
-        else
-        {
-            crossroads_[coords.front()].insert(id);
-        }
-
-        if(crossroads_.find(coords.back()) == crossroads_.end())
-        {
-            crossroads_[coords.back()] = {id};
+            auto& crossroad = crossroads_[end == 0 ? coords.front() : coords.back()];
+            if (crossroad.ways.empty())
+            {
+                crossroad.vertex = add_connectivity_vertex();
+            }
+            crossroad.ways.emplace(id, end == 0 ? coords.back() : coords.front());
+            vertices[end] = crossroad.vertex;
         }
-        else
+        // A loop connects nothing, so it isn't an edge for connectivity
+        if (vertices[0] != vertices[1])
         {
-            crossroads_[coords.back()].insert(id);
+            insert_connectivity_edge(id, vertices[0], vertices[1]);
         }
+        invalidate_routes_after_add(way_to_add);
 
         return true;
     }
@@ -536,20 +4160,12 @@ bool Datastructures::add_way(WayID id, std::vector<Coord> coords)
 
 std::vector<std::pair<WayID, Coord>> Datastructures::ways_from(Coord xy)
 {
-    std::vector<std::pair<WayID, Coord>> found_ways;
-    for(auto way : ways_)
+    auto crossroad = crossroads_.find(xy);
+    if (crossroad == crossroads_.end())
     {
-        if(way.second->coords.front() == xy)
-        {
-            found_ways.push_back({way.first, way.second->coords.back()});
-        }
-        else if(way.second->coords.back() == xy)
-        {
-            found_ways.push_back({way.first, way.second->coords.front()});
-        }
+        return {};
     }
-
-    return found_ways;
+    return {crossroad->second.ways.begin(), crossroad->second.ways.end()};
 }
 
 std::vector<Coord> Datastructures::get_way_coords(WayID id)
@@ -565,49 +4181,343 @@ void Datastructures::clear_ways()
 {
     ways_.clear();
     crossroads_.clear();
+    graph_dirty_ = true;
+    clear_connectivity();
+    clear_route_cache();
 }
 
 std::vector<std::tuple<Coord, WayID, Distance> > Datastructures::route_any(Coord fromxy, Coord toxy)
 {
-    if (crossroads_.find(fromxy) == crossroads_.end()
-            || crossroads_.find(toxy) == crossroads_.end())
+    return cached_route(fromxy, toxy, RouteMetric::ANY);
+}
+
+bool Datastructures::remove_way(WayID id)
+{
+    auto way = ways_.find(id);
+    if (way == ways_.end())
     {
-        return {{NO_COORD, NO_WAY, NO_DISTANCE}};
+        return false;
     }
 
-    return dfs(fromxy, toxy);
+    erase_way(way);
+    return true;
 }
 
-bool Datastructures::remove_way(WayID id)
+void Datastructures::erase_way(std::unordered_map<WayID, std::shared_ptr<Way>>::iterator way)
 {
-    if(ways_.find(id) != ways_.end())
+    // Crossroads that no way meets anymore are dropped
+    WayID id = way->first;
+    delete_connectivity_edge(id);
+    for (Coord xy : {way->second->coords.front(), way->second->coords.back()})
     {
-        ways_.erase(id);
-        return true;
+        auto crossroad = crossroads_.find(xy);
+        if (crossroad != crossroads_.end())
+        {
+            crossroad->second.ways.erase(id);
+            if (crossroad->second.ways.empty())
+            {
+                remove_connectivity_vertex(crossroad->second.vertex);
+                crossroads_.erase(crossroad);
+            }
+        }
     }
-    return false;
+    ways_.erase(way);
+    graph_dirty_ = true;
+    invalidate_routes_using(id);
 }
 
 std::vector<std::tuple<Coord, WayID, Distance> > Datastructures::route_least_crossroads(Coord fromxy, Coord toxy)
 {
-    // Replace this comment with your implementation
-    return {{NO_COORD, NO_WAY, NO_DISTANCE}};
+    return cached_route(fromxy, toxy, RouteMetric::LEAST_CROSSROADS);
 }
 
 std::vector<std::tuple<Coord, WayID> > Datastructures::route_with_cycle(Coord fromxy)
 {
-    // Replace this comment with your implementation
-    return {{NO_COORD, NO_WAY}};
+    if (crossroads_.find(fromxy) == crossroads_.end())
+    {
+        return {{NO_COORD, NO_WAY}};
+    }
+
+    update_routing_graph();
+    return cycle_dfs(find_graph_node(fromxy), route_search_);
 }
 
 std::vector<std::tuple<Coord, WayID, Distance> > Datastructures::route_shortest_distance(Coord fromxy, Coord toxy)
 {
-    // Replace this comment with your implementation
-    return {{NO_COORD, NO_WAY, NO_DISTANCE}};
+    return cached_route(fromxy, toxy, RouteMetric::SHORTEST_DISTANCE);
+}
+
+std::vector<std::pair<Coord, Distance>> Datastructures::reachable_within(Coord xy, Distance max_distance)
+{
+    if (crossroads_.find(xy) == crossroads_.end())
+    {
+        return {{NO_COORD, NO_DISTANCE}};
+    }
+
+    update_routing_graph();
+    return isochrone(find_graph_node(xy), max_distance, route_search_);
+}
+
+std::vector<std::pair<PlaceID, Distance>> Datastructures::places_reachable_within(Coord xy, Distance max_distance)
+{
+    if (crossroads_.find(xy) == crossroads_.end())
+    {
+        return {{NO_PLACE, NO_DISTANCE}};
+    }
+
+    update_routing_graph();
+    auto reached = isochrone(find_graph_node(xy), max_distance, route_search_);
+
+    // Places standing on a reached crossroad, nearest crossroads first
+    std::vector<std::pair<PlaceID, Distance>> places;
+    for (auto const& [coord, distance] : reached)
+    {
+        for (auto it = place_coords_.lower_bound({coord, std::numeric_limits<PlaceID>::min()});
+             it != place_coords_.end() && it->first == coord; ++it)
+        {
+            places.emplace_back(it->second, distance);
+        }
+    }
+    return places;
+}
+
+void Datastructures::prepare_routing()
+{
+    update_routing_graph();
+    if (!contraction_ready_)
+    {
+        build_contraction_hierarchy();
+    }
+}
+
+RouteCacheStats Datastructures::route_cache_stats()
+{
+    auto stats = route_cache_stats_;
+    stats.entries = route_cache_.size();
+    return stats;
+}
+
+std::vector<std::vector<std::tuple<Coord, WayID, Distance>>> Datastructures::route_batch(RouteMetric metric,
+                                                                                       std::vector<std::pair<Coord, Coord>> const& queries)
+{
+    // The workers only read, connectivity splays so it is answered here
+    std::vector<bool> connected_queries(queries.size());
+    for (unsigned query = 0; query < queries.size(); ++query)
+    {
+        connected_queries[query] = connected(queries[query].first, queries[query].second);
+    }
+    update_routing_graph();
+    if (metric == RouteMetric::SHORTEST_DISTANCE)
+    {
+        prepare_route_algorithm(route_algorithm_);
+    }
+
+    unsigned workers = route_batch_threads_ != 0 ? route_batch_threads_ : worker_count();
+    workers = std::max(1u, std::min<unsigned>(workers, queries.size()));
+    if (route_batch_searches_.size() < workers)
+    {
+        route_batch_searches_.resize(workers);
+    }
+
+    std::vector<std::vector<std::tuple<Coord, WayID, Distance>>> routes(queries.size());
+    parallel_for_dynamic(queries.size(), 8, workers, [this, metric, &queries, &connected_queries, &routes](unsigned worker, unsigned begin, unsigned end)
+    {
+        auto& search = route_batch_searches_[worker];
+        for (unsigned query = begin; query < end; ++query)
+        {
+            unsigned from = find_graph_node(queries[query].first);
+            unsigned to = find_graph_node(queries[query].second);
+            if (from == NO_INDEX || to == NO_INDEX)
+            {
+                routes[query] = {{NO_COORD, NO_WAY, NO_DISTANCE}};
+            }
+            else if (!connected_queries[query])
+            {
+                routes[query] = {};
+            }
+            else
+            {
+                routes[query] = find_route(from, to, metric, search);
+            }
+        }
+    });
+    return routes;
+}
+
+void Datastructures::set_route_batch_threads(unsigned threads)
+{
+    route_batch_threads_ = threads;
+}
+
+std::vector<std::vector<Distance>> Datastructures::distance_matrix(std::vector<Coord> const& sources,
+                                                                   std::vector<Coord> const& targets)
+{
+    update_routing_graph();
+    auto find_node = [this](Coord xy) { return find_graph_node(xy); };
+    std::vector<unsigned> source_nodes;
+    std::vector<unsigned> target_nodes;
+    std::transform(sources.begin(), sources.end(), std::back_inserter(source_nodes), find_node);
+    std::transform(targets.begin(), targets.end(), std::back_inserter(target_nodes), find_node);
+    if (contraction_ready_)
+    {
+        return contraction_distance_matrix(source_nodes, target_nodes);
+    }
+
+    std::vector<std::vector<Distance>> matrix(sources.size(), std::vector<Distance>(targets.size(), NO_DISTANCE));
+    parallel_for(sources.size(), 16, [this, &source_nodes, &target_nodes, &matrix](unsigned, unsigned begin, unsigned end)
+    {
+        RouteWorkspace workspace;
+        RadixHeap heap;
+        for (unsigned source = begin; source < end; ++source)
+        {
+            if (source_nodes[source] == NO_INDEX)
+            {
+                continue;
+            }
+            find_distances(source_nodes[source], target_nodes, workspace, heap);
+            for (unsigned target = 0; target < target_nodes.size(); ++target)
+            {
+                unsigned node = target_nodes[target];
+                if (node != NO_INDEX && workspace.reached(node))
+                {
+                    matrix[source][target] = workspace.distances[node];
+                }
+            }
+        }
+    });
+    return matrix;
+}
+
+void Datastructures::set_route_algorithm(RouteAlgorithm algorithm)
+{
+    // Cached routes were found by the previous algorithm
+    if (algorithm != route_algorithm_)
+    {
+        clear_route_cache();
+    }
+    route_algorithm_ = algorithm;
+}
+
+void Datastructures::set_parallel_bfs(bool parallel)
+{
+    route_search_.parallel_bfs = parallel;
+}
+
+int Datastructures::route_search_expansions(Coord fromxy, Coord toxy, RouteAlgorithm algorithm)
+{
+    if (crossroads_.find(fromxy) == crossroads_.end()
+            || crossroads_.find(toxy) == crossroads_.end())
+    {
+        return NO_VALUE;
+    }
+
+    update_routing_graph();
+    prepare_route_algorithm(algorithm);
+    shortest_route(find_graph_node(fromxy), find_graph_node(toxy), algorithm, route_search_);
+    return route_search_.forward.expanded;
 }
 
 Distance Datastructures::trim_ways()
 {
-    // Replace this comment with your implementation
-    return NO_DISTANCE;
+    // Crossroad ids from the sorted way ends, cheaper than hashing for one pass
+    std::vector<Way const*> way_list;
+    way_list.reserve(ways_.size());
+    for (auto const& way : ways_)
+    {
+        way_list.push_back(way.second.get());
+    }
+    unsigned way_count = way_list.size();
+    std::vector<std::pair<Coord, unsigned>> way_ends(2 * std::size_t(way_count));
+    parallel_for(way_count, 65536, [&way_list, &way_ends](unsigned, unsigned begin, unsigned end)
+    {
+        for (unsigned way = begin; way < end; ++way)
+        {
+            way_ends[2 * way] = {way_list[way]->coords.front(), 2 * way};
+            way_ends[2 * way + 1] = {way_list[way]->coords.back(), 2 * way + 1};
+        }
+    });
+    parallel_sort(way_ends.begin(), way_ends.end(), [](auto const& end1, auto const& end2)
+    {
+        return end1.first < end2.first;
+    });
+    std::vector<unsigned> end_nodes(way_ends.size());
+    unsigned node_count = 0;
+    for (std::size_t end = 0; end < way_ends.size(); ++end)
+    {
+        if (end == 0 || way_ends[end].first != way_ends[end - 1].first)
+        {
+            ++node_count;
+        }
+        end_nodes[way_ends[end].second] = node_count - 1;
+    }
+
+    // Kruskal, ties broken by id so the result doesn't depend on the way order
+    std::vector<unsigned> candidates;
+    candidates.reserve(way_count);
+    for (unsigned way = 0; way < way_count; ++way)
+    {
+        if (end_nodes[2 * way] != end_nodes[2 * way + 1])
+        {
+            candidates.push_back(way);
+        }
+    }
+    parallel_sort(candidates.begin(), candidates.end(), [&way_list](unsigned way1, unsigned way2)
+    {
+        return way_list[way1]->length != way_list[way2]->length ? way_list[way1]->length < way_list[way2]->length
+                                                                : way_list[way1]->id < way_list[way2]->id;
+    });
+    DisjointSets trees;
+    trees.reset(node_count);
+    std::vector<bool> kept(way_count, false);
+    long long total = 0;
+    for (unsigned way : candidates)
+    {
+        if (trees.unite(end_nodes[2 * way], end_nodes[2 * way + 1]))
+        {
+            kept[way] = true;
+            total += way_list[way]->length;
+        }
+    }
+
+    // The forest is built anew instead of removing every other way one by one
+    clear_connectivity();
+    connectivity_vertices_.resize(node_count);
+    for (auto& crossroad : crossroads_)
+    {
+        auto end = std::lower_bound(way_ends.begin(), way_ends.end(), crossroad.first, [](auto const& way_end, Coord xy)
+        {
+            return way_end.first < xy;
+        });
+        crossroad.second.vertex = end_nodes[end->second];
+    }
+    std::vector<unsigned> forest;
+    for (unsigned way : candidates)
+    {
+        if (kept[way])
+        {
+            forest.push_back(create_connectivity_edge(way_list[way]->id, end_nodes[2 * way], end_nodes[2 * way + 1]));
+        }
+    }
+    build_connectivity_forest(forest);
+
+    // The ways left out of the forest are removed in one go
+    for (unsigned way = 0; way < way_count; ++way)
+    {
+        if (!kept[way])
+        {
+            erase_way(ways_.find(way_list[way]->id));
+        }
+    }
+    return total;
+}
+
+bool Datastructures::connected(Coord xy1, Coord xy2)
+{
+    auto crossroad1 = crossroads_.find(xy1);
+    auto crossroad2 = crossroads_.find(xy2);
+    if (crossroad1 == crossroads_.end() || crossroad2 == crossroads_.end())
+    {
+        return false;
+    }
+    return vertices_connected(crossroad1->second.vertex, crossroad2->second.vertex);
 }
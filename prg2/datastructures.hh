@@ -11,6 +11,11 @@
 #include <functional>
 #include <memory>
 #include <unordered_set>
+#include <unordered_map>
+#include <set>
+#include <list>
+#include <algorithm>
+#include <cstdint>
 
 // Types for IDs
 using PlaceID = long long int;
@@ -70,6 +75,38 @@ inline bool operator<(Coord c1, Coord c2)
 // Return value for cases where coordinates were not found
 Coord const NO_COORD = {NO_VALUE, NO_VALUE};
 
+// Axis-aligned bounding box of a set of coordinates, min and max inclusive
+struct BoundingBox
+{
+    Coord min = NO_COORD;
+    Coord max = NO_COORD;
+};
+
+inline bool box_contains(BoundingBox const& box, Coord xy)
+{
+    return box.min.x <= xy.x && xy.x <= box.max.x && box.min.y <= xy.y && xy.y <= box.max.y;
+}
+
+inline bool boxes_intersect(BoundingBox const& b1, BoundingBox const& b2)
+{
+    return b1.min.x <= b2.max.x && b2.min.x <= b1.max.x && b1.min.y <= b2.max.y && b2.min.y <= b1.max.y;
+}
+
+// Geometry summary of an area polygon (closed from its last coordinate to the first)
+struct AreaInfo
+{
+    BoundingBox box;
+    BoundingBox subtree_box; // Covers the area and all of its subareas
+    double signed_area = 0; // Positive if the coordinates go counterclockwise
+    double perimeter = 0;
+    double centroid_x = 0;
+    double centroid_y = 0;
+    bool convex = false;
+};
+
+// Return value for cases where area info was not found
+AreaInfo const NO_AREA_INFO = {};
+
 // Type for a distance (in metres)
 using Distance = int;
 
@@ -89,8 +126,6 @@ struct Area
     AreaID id = NO_AREA;
     Name name = NO_NAME;
     std::vector<Coord> coords;
-    std::shared_ptr<Area> parent = nullptr;
-    std::vector<std::shared_ptr<Area>> subareas;
 };
 
 struct Way
@@ -100,13 +135,21 @@ struct Way
     Distance length = 0;
 };
 
-// Not used
-struct Node
+// Search algorithms that route_shortest_distance can use
+enum class RouteAlgorithm { DIJKSTRA, ASTAR, BIDIRECTIONAL, CONTRACTION, LANDMARKS, NO_ALGORITHM };
+
+// What a route is chosen by: any route, fewest crossroads or shortest distance
+enum class RouteMetric { ANY, LEAST_CROSSROADS, SHORTEST_DISTANCE, NO_METRIC };
+
+// Counters of the route result cache
+struct RouteCacheStats
 {
-    Coord pos = NO_COORD;
-    unsigned g = 0;
-    unsigned h = 0;
-    unsigned f = 0;
+    unsigned long long hits = 0;
+    unsigned long long misses = 0;
+    unsigned long long evictions = 0; // Least recently used routes dropped to stay within the budget
+    unsigned long long invalidations = 0; // Routes dropped because the ways changed
+    std::size_t entries = 0;
+    std::size_t bytes = 0; // Estimated memory use of the cached routes
 };
 
 // This is the class you are supposed to implement
@@ -185,12 +228,12 @@ public:
     // Short rationale for estimate: iterates through all areas
     std::vector<AreaID> all_areas();
 
-    // Estimate of performance: O(n)
-    // Short rationale for estimate: unordered_map::find called twice
+    // Estimate of performance: O(1), O(d) if the area has subareas, d = depth of the parent
+    // Short rationale for estimate: checks that the area isn't an ancestor of the parent
     bool add_subarea_to_area(AreaID id, AreaID parentid);
 
-    // Estimate of performance: O(n)
-    // Short rationale for estimate: unordered_map::find
+    // Estimate of performance: O(d), d = depth of the area
+    // Short rationale for estimate: follows parent indices up to the root
     std::vector<AreaID> subarea_in_areas(AreaID id);
 
     // Non-compulsory operations
@@ -199,10 +242,14 @@ public:
     // Short rationale for estimate:
     void creation_finished();
 
-    // Estimate of performance: O(n)
-    // Short rationale for estimate: unordered_map::find
+    // Estimate of performance: O(k), O(n) on the first call after areas have changed
+    // Short rationale for estimate: subareas are a contiguous range in preorder
     std::vector<AreaID> all_subareas_in_area(AreaID id);
 
+    // Estimate of performance: O(1), O(nlogn) on the first call after areas have changed
+    // Short rationale for estimate: compares preorder intervals
+    bool is_subarea_of(AreaID id, AreaID parentid);
+
     // Estimate of performance: too much
     // Short rationale for estimate: wrote a terrible but somewhat working solution
     std::vector<PlaceID> places_closest_to(Coord xy, PlaceType type);
@@ -211,22 +258,70 @@ public:
     // Short rationale for estimate: unordered_map::find
     bool remove_place(PlaceID id);
 
-    // Estimate of performance: O(n) maybe?
-    // Short rationale for estimate: calls unordered_map::find a few times
+    // Estimate of performance: O(1), O(nlogn) on the first call after areas have changed
+    // Short rationale for estimate: range minimum query over the Euler tour sparse table
     AreaID common_area_of_subareas(AreaID id1, AreaID id2);
 
+    // Estimate of performance: O(n/t + t), t = number of threads, O(nlogn) on the first call after areas have changed
+    // Short rationale for estimate: threads fold constant time common area queries
+    AreaID common_area_of_many(std::vector<AreaID> const& ids);
+
+    // Estimate of performance: O(q + a + k/t), a = ancestors walked, k = total number of returned areas
+    // Short rationale for estimate: each ancestor is walked at most once per batch, results are copied in parallel
+    std::vector<std::vector<AreaID>> subarea_in_areas_batch(std::vector<AreaID> const& ids);
+
+    // Estimate of performance: O(logn) amortized, O(klogn) for an area with k direct subareas
+    // Short rationale for estimate: subareas are relinked to the parent in the link-cut tree
+    bool remove_area(AreaID id);
+
+    // Estimate of performance: O(logn) amortized
+    // Short rationale for estimate: link-cut tree cut and link
+    bool move_subarea(AreaID id, AreaID parentid);
+
+    // Estimate of performance: O(logn) amortized, O(1) when the area index is up to date
+    // Short rationale for estimate: virtual subtree sizes of the link-cut tree
+    int subarea_count(AreaID id);
+
+    // Estimate of performance: O(1), O(plogn/t) on the first call
+    // Short rationale for estimate: places are assigned to their innermost area in parallel
+    AreaID area_of_place(PlaceID id);
+
+    // Estimate of performance: O(k + s), s = number of subareas when recursive
+    // Short rationale for estimate: concatenates the place lists of the area's preorder range
+    std::vector<PlaceID> places_in_area(AreaID id, bool recursive);
+
+    // Estimate of performance: O(logn), O(s) while the hierarchy is changing
+    // Short rationale for estimate: Fenwick tree range sum over the area's preorder range
+    int place_count_in_area(AreaID id);
+
+    // Estimate of performance: O(1), O(n) on the first call after areas have changed
+    // Short rationale for estimate: summaries are computed when areas are added, subtree boxes in one postorder pass
+    AreaInfo area_info(AreaID id);
+
+    // Estimate of performance: O(clogn + k), c = number of area size classes
+    // Short rationale for estimate: R-tree queries, exact tests only for areas crossing the rectangle's edges
+    std::vector<AreaID> areas_in_rect(BoundingBox const& rect);
+
+    // Estimate of performance: O(s), O(n) on the first call after areas have changed
+    // Short rationale for estimate: walks the s areas of the subtree, skipping subtrees whose box misses the rectangle
+    std::vector<AreaID> areas_in_rect(BoundingBox const& rect, AreaID root);
+
+    // Estimate of performance: O(nlogn + k*m/t), k = candidate pairs, m = vertices per area
+    // Short rationale for estimate: R-tree candidates, threads check each pair with an edge sweep
+    std::vector<std::pair<AreaID, AreaID>> overlapping_areas();
+
     // Phase 2 operations
 
     // Estimate of performance: O(n)
     // Short rationale for estimate: std::transorfm
     std::vector<WayID> all_ways();
 
-    // Estimate of performance: O(n)
-    // Short rationale for estimate: std::find
+    // Estimate of performance: O(logn + r) amortized, r = cached shortest routes starting near the way's ends
+    // Short rationale for estimate: links the way into the spanning forest, checks only the cached routes it could beat
     bool add_way(WayID id, std::vector<Coord> coords);
 
-    // Estimate of performance: O(n)
-    // Short rationale for estimate: iterates through all ways
+    // Estimate of performance: O(k), k = number of ways from the coord
+    // Short rationale for estimate: copies the ways of the crossroad
     std::vector<std::pair<WayID, Coord>> ways_from(Coord xy);
 
     // Estimate of performance: O(n)
@@ -237,42 +332,439 @@ public:
     // Short rationale for estimate: unordered_map::clear
     void clear_ways();
     
-    // Estimate of performance: O(n)
-    // Short rationale for estimate: each node is traversed once
+    // Estimate of performance: O(V + E), O(logn) if the crossroads aren't connected
+    // Short rationale for estimate: DFS over the routing graph, which is rebuilt first if ways have changed
     std::vector<std::tuple<Coord, WayID, Distance>> route_any(Coord fromxy, Coord toxy);
 
     // Non-compulsory operations
 
-    // Estimate of performance:
-    // Short rationale for estimate:
+    // Estimate of performance: O(log^2 n) amortized
+    // Short rationale for estimate: unordered_map::erase at the way and its crossroads, replacement search pays for itself by raising edge levels
     bool remove_way(WayID id);
 
-    // Estimate of performance:
-    // Short rationale for estimate:
+    // Estimate of performance: O(V + E), O(logn) if the crossroads aren't connected
+    // Short rationale for estimate: level-synchronous BFS, each level top-down or bottom-up over bitsets
     std::vector<std::tuple<Coord, WayID, Distance>> route_least_crossroads(Coord fromxy, Coord toxy);
 
-    // Estimate of performance:
-    // Short rationale for estimate:
+    // Estimate of performance: O(V + E)
+    // Short rationale for estimate: iterative DFS that stops at the first back edge
     std::vector<std::tuple<Coord, WayID>> route_with_cycle(Coord fromxy);
 
-    // Estimate of performance:
-    // Short rationale for estimate:
+    // Estimate of performance: O(V + ElogC), C = longest way, O(logn) if the crossroads aren't connected
+    // Short rationale for estimate: Dijkstra with a radix heap, each entry moves to a lower bucket at most logC times
     std::vector<std::tuple<Coord, WayID, Distance>> route_shortest_distance(Coord fromxy, Coord toxy);
 
-    // Estimate of performance:
-    // Short rationale for estimate:
+    // Estimate of performance: O(c)
+    // Short rationale for estimate: stores the algorithm, changing it drops the c cached routes
+    void set_route_algorithm(RouteAlgorithm algorithm);
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: stores whether route_least_crossroads expands bottom-up levels on several threads
+    void set_parallel_bfs(bool parallel);
+
+    // Estimate of performance: as route_shortest_distance with the given algorithm
+    // Short rationale for estimate: runs the search and counts the crossroads it expanded
+    int route_search_expansions(Coord fromxy, Coord toxy, RouteAlgorithm algorithm);
+
+    // Estimate of performance: O(n*w), w = cost of the witness searches of a crossroad
+    // Short rationale for estimate: contracts each crossroad once, priorities are first computed in parallel
+    void prepare_routing();
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: returns the counters kept by the route cache
+    RouteCacheStats route_cache_stats();
+
+    // Estimate of performance: O(q*r/t), r = cost of one route with the metric
+    // Short rationale for estimate: the queries are shared out to one worker per thread, each with its own search state
+    std::vector<std::vector<std::tuple<Coord, WayID, Distance>>> route_batch(RouteMetric metric,
+                                                                            std::vector<std::pair<Coord, Coord>> const& queries);
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: stores the number of route_batch workers, 0 for one per hardware thread
+    void set_route_batch_threads(unsigned threads);
+
+    // Estimate of performance: O(s*(V + ElogC)/t), t = number of threads, O((s + m)*u*logC/t + s*m) after prepare_routing, u = crossroads above one in the hierarchy
+    // Short rationale for estimate: one multi-target Dijkstra per source in parallel, or upward searches meeting in buckets
+    std::vector<std::vector<Distance>> distance_matrix(std::vector<Coord> const& sources, std::vector<Coord> const& targets);
+
+    // Estimate of performance: O(V + ElogE/t), t = number of threads
+    // Short rationale for estimate: Kruskal over ways sorted in parallel, union-find is nearly O(1) per way
     Distance trim_ways();
 
+    // Estimate of performance: O(logn) amortized
+    // Short rationale for estimate: compares the roots of the crossroads' Euler tour trees in the spanning forest
+    bool connected(Coord xy1, Coord xy2);
+
+    // Estimate of performance: O(V' + E'logC), V' and E' = crossroads and ways within the distance
+    // Short rationale for estimate: Dijkstra that never pushes crossroads beyond max_distance, reusing the route workspace
+    std::vector<std::pair<Coord, Distance>> reachable_within(Coord xy, Distance max_distance);
+
+    // Estimate of performance: O(V' + E'logC + V'logn), V' and E' = crossroads and ways within the distance
+    // Short rationale for estimate: as reachable_within, then each reached crossroad is looked up in the place coordinate set
+    std::vector<std::pair<PlaceID, Distance>> places_reachable_within(Coord xy, Distance max_distance);
+
 private:
     std::unordered_map<PlaceID, std::shared_ptr<Place>> places_;
-    std::unordered_map<AreaID, std::shared_ptr<Area>> areas_;
     std::unordered_map<WayID, std::shared_ptr<Way>> ways_;
-    std::unordered_map<Coord, std::unordered_set<WayID>, CoordHash> crossroads_;
+    // Ways meeting at each crossroad with their other ends, kept by add_way and remove_way
+    struct Crossroad
+    {
+        std::unordered_map<WayID, Coord> ways;
+        unsigned vertex = 0;
+    };
+    std::unordered_map<Coord, Crossroad, CoordHash> crossroads_;
+
+    // Areas in a dense vector with the hierarchy as an index forest, removed slots are reused
+    static unsigned constexpr NO_INDEX = std::numeric_limits<unsigned>::max();
+    std::unordered_map<AreaID, unsigned> area_indices_;
+    std::vector<Area> areas_;
+    std::vector<unsigned> area_parent_;
+    std::vector<unsigned> area_first_child_;
+    std::vector<unsigned> area_next_sibling_;
+    std::vector<unsigned> area_prev_sibling_;
+    std::vector<unsigned> free_area_indices_;
+
+    // Link-cut tree mirroring the area forest while the hierarchy is changing
+    struct LinkCutNode
+    {
+        unsigned left = NO_INDEX;
+        unsigned right = NO_INDEX;
+        unsigned parent = NO_INDEX; // Parent in the splay tree or path parent
+        unsigned size = 1; // Nodes in the splay subtree, including virtual subtrees
+        unsigned virtual_size = 0; // Nodes in subtrees attached by path parent pointers
+    };
+    std::vector<LinkCutNode> area_lct_;
+
+    // Reused scratch buffers for walking the area forest without recursion
+    struct AreaWalkBuffers
+    {
+        std::vector<std::pair<unsigned, unsigned>> stack; // area, next subarea to enter
+        std::vector<unsigned> queue;
+    };
+    AreaWalkBuffers area_walk_;
+
+    // Lazily rebuilt preorder ranges and Euler tour sparse table of the area forest
+    bool area_index_dirty_ = true;
+    unsigned area_queries_since_change_ = 0;
+    std::vector<unsigned> area_roots_;
+    std::vector<unsigned> area_euler_index_;
+    std::vector<unsigned> area_preorder_begin_;
+    std::vector<unsigned> area_preorder_end_;
+    std::vector<unsigned> preorder_areas_;
+    std::vector<unsigned> euler_tour_;
+    std::vector<unsigned> euler_depths_;
+    std::vector<unsigned> euler_log_;
+    std::vector<std::vector<unsigned>> euler_sparse_;
+
+    // Area summaries, exact doubled sizes and lazily aggregated subtree boxes
+    std::vector<AreaInfo> area_infos_;
+    std::vector<long long> area_twice_sizes_;
+    bool area_subtree_boxes_dirty_ = true;
+
+    // STR-packed R-trees of area boxes, one per size class from small to large
+    struct AreaRTree
+    {
+        long long min_size = 0; // Smallest absolute doubled size of the items
+        std::vector<unsigned> items;
+        std::vector<std::vector<BoundingBox>> levels;
+    };
+    static unsigned constexpr RTREE_FANOUT = 16;
+    std::vector<unsigned> area_rtree_pending_;
+    std::vector<AreaRTree> area_rtrees_;
+    std::vector<bool> area_in_rtree_;
+    unsigned area_rtree_size_ = 0;
+
+    // Innermost area of each place, assigned lazily; place_coords_ is always current
+    struct PlaceArea
+    {
+        unsigned area = NO_INDEX;
+        unsigned position = 0;
+    };
+    bool place_areas_dirty_ = true;
+    std::unordered_map<PlaceID, PlaceArea> place_areas_;
+    std::vector<std::vector<PlaceID>> area_places_;
+    std::set<std::pair<Coord, PlaceID>> place_coords_;
+
+    // Fenwick tree of place counts by area preorder position
+    bool area_place_counts_dirty_ = true;
+    std::vector<unsigned> area_place_counts_;
+
+    // CSR routing graph with dense node ids, rebuilt after the ways have changed
+    bool graph_dirty_ = true;
+    std::unordered_map<Coord, unsigned, CoordHash> graph_node_ids_;
+    std::vector<Coord> graph_coords_;
+    std::vector<unsigned> graph_offsets_;
+    std::vector<unsigned> graph_targets_;
+    std::vector<unsigned> graph_ways_;
+    std::vector<Distance> graph_lengths_;
+    std::vector<WayID> graph_way_ids_;
+
+    // Smallest way length to straight distance ratio, scales the A* heuristic to a lower bound
+    double graph_min_stretch_ = 1;
+
+    // Disjoint sets of node ids, with union by size and path halving
+    struct DisjointSets
+    {
+        std::vector<unsigned> parents;
+        std::vector<unsigned> sizes;
+
+        void reset(unsigned count);
+        unsigned find(unsigned node);
+        bool unite(unsigned node1, unsigned node2); // False if they were in the same set already
+    };
+
+    // Per-node search state reused between queries, valid only where the stamp is current
+    struct RouteWorkspace
+    {
+        std::vector<unsigned> stamps;
+        std::vector<Distance> distances;
+        std::vector<unsigned> parent_edges;
+        std::vector<unsigned> target_stamps; // Nodes a multi-target search waits for
+        std::vector<unsigned> stack;
+        unsigned stamp = 0;
+        unsigned expanded = 0; // Nodes expanded by the current search
+
+        void start(unsigned node_count);
+        bool reached(unsigned node) const { return stamps[node] == stamp; }
+        void reach(unsigned node, Distance distance, unsigned parent_edge);
+        void mark_target(unsigned node) { target_stamps[node] = stamp; }
+        bool is_target(unsigned node) const { return target_stamps[node] == stamp; }
+    };
+
+    // Monotone radix heap of (distance, node) entries bucketed by the highest differing bit
+    struct RadixHeap
+    {
+        static unsigned constexpr BUCKETS = std::numeric_limits<unsigned>::digits + 1;
+        std::vector<std::pair<Distance, unsigned>> buckets[BUCKETS];
+        Distance last = 0;
+        unsigned size = 0;
+
+        void clear();
+        void push(Distance distance, unsigned node);
+        std::pair<Distance, unsigned> top();
+        std::pair<Distance, unsigned> pop();
+    };
+
+    // Indexed binary heap for A* with in-place decrease-key
+    struct IndexedHeap
+    {
+        std::vector<std::pair<double, unsigned>> entries;
+        std::vector<unsigned> positions;
+
+        void clear(unsigned node_count);
+        bool contains(unsigned node) const { return positions[node] != NO_INDEX; }
+        void push_or_decrease(double priority, unsigned node, bool reached);
+        unsigned pop();
+        void sift_up(unsigned position);
+        void sift_down(unsigned position);
+    };
+
+    // Contraction hierarchy with undirected arcs, a shortcut joins arcs first and second
+    struct ContractionArc
+    {
+        unsigned from = NO_INDEX;
+        unsigned to = NO_INDEX;
+        Distance length = 0;
+        unsigned way = NO_INDEX; // Way handle of an original arc
+        unsigned first = NO_INDEX; // Arcs of a shortcut, first one touches from
+        unsigned second = NO_INDEX;
+    };
+    using ContractionAdjacency = std::vector<std::vector<std::pair<unsigned, unsigned>>>; // neighbour, arc
+    static unsigned constexpr WITNESS_SETTLE_LIMIT = 60;
+    bool contraction_ready_ = false;
+    std::vector<ContractionArc> contraction_arcs_;
+    std::vector<unsigned> contraction_up_offsets_;
+    std::vector<unsigned> contraction_up_arcs_;
+
+    // ALT landmarks and their distances to every crossroad, stored node by node
+    static unsigned constexpr LANDMARK_COUNT = 16;
+    bool landmarks_ready_ = false;
+    std::vector<Coord> landmark_coords_;
+    std::vector<Distance> landmark_distances_;
+
+    // Direction-optimizing BFS bitsets, parent is the smallest frontier node either way
+    static unsigned constexpr BFS_ALPHA = 14;
+    static unsigned constexpr BFS_BETA = 24;
+
+    // Everything a route search writes to, one per parallel search
+    struct RouteSearch
+    {
+        RouteWorkspace forward;
+        RouteWorkspace backward; // Search from the destination in bidirectional searches
+        RadixHeap forward_heap;
+        RadixHeap backward_heap;
+        IndexedHeap indexed_heap;
+        std::vector<std::uint64_t> bfs_frontier;
+        std::vector<std::uint64_t> bfs_next;
+        std::vector<std::uint64_t> bfs_visited;
+        std::vector<std::uint8_t> colours; // Of nodes reached by forward in cycle_dfs
+        std::vector<std::pair<unsigned, unsigned>> dfs_path; // Node, next edge to look at
+        bool parallel_bfs = false; // Bottom-up BFS levels are expanded on several threads
+    };
+
+    // Unreached nodes are white (0), so colours need no clearing between searches
+    static std::uint8_t constexpr GRAY = 1;
+    static std::uint8_t constexpr BLACK = 2;
+
+    // LRU route cache by (from, to, metric), indexed for invalidation on way edits
+    struct RouteCacheKey
+    {
+        Coord from = NO_COORD;
+        Coord to = NO_COORD;
+        RouteMetric metric = RouteMetric::ANY;
+
+        bool operator==(RouteCacheKey const& other) const
+        {
+            return from == other.from && to == other.to && metric == other.metric;
+        }
+    };
+    struct RouteCacheKeyHash
+    {
+        std::size_t operator()(RouteCacheKey const& key) const;
+    };
+    struct RouteCacheEntry
+    {
+        RouteCacheKey key;
+        std::vector<std::tuple<Coord, WayID, Distance>> route;
+        std::size_t bytes = 0;
+    };
+    static std::size_t constexpr ROUTE_CACHE_BUDGET = 16 << 20;
+    std::list<RouteCacheEntry> route_cache_lru_;
+    std::unordered_map<RouteCacheKey, std::list<RouteCacheEntry>::iterator, RouteCacheKeyHash> route_cache_;
+    std::unordered_map<WayID, std::unordered_set<RouteCacheKey, RouteCacheKeyHash>> route_cache_ways_;
+    std::vector<std::set<std::pair<Coord, Coord>>> route_cache_shortest_;
+    std::set<std::tuple<Coord, Coord, Coord>> route_cache_three_way_ends_; // End, from, to
+    std::unordered_set<RouteCacheKey, RouteCacheKeyHash> route_cache_always_stale_;
+    double route_cache_min_stretch_ = 1;
+    RouteCacheStats route_cache_stats_;
+
+    // Holm-de Lichtenberg-Thorup dynamic connectivity over Euler tour splay trees per level
+    struct EulerNode
+    {
+        unsigned left = NO_INDEX;
+        unsigned right = NO_INDEX;
+        unsigned parent = NO_INDEX;
+        unsigned item = NO_INDEX; // Crossroad id, or edge id of an arc
+        bool arc = false;
+        unsigned crossroads = 0; // Crossroad nodes in the splay subtree
+        std::uint8_t flags = 0;
+        std::uint8_t subtree_flags = 0;
+    };
+    static std::uint8_t constexpr LEVEL_TREE_EDGE = 1; // Arc of a tree edge of the forest's level
+    static std::uint8_t constexpr LEVEL_NON_TREE_EDGES = 2; // Crossroad with non-tree edges of the level
+    struct ConnectivityVertex
+    {
+        std::vector<unsigned> nodes; // Tour node in each forest, NO_INDEX until needed
+        std::vector<std::vector<unsigned>> non_tree_edges; // By level
+    };
+    struct ConnectivityEdge
+    {
+        unsigned ends[2] = {NO_INDEX, NO_INDEX};
+        unsigned positions[2] = {0, 0}; // In the non-tree edge lists of the ends
+        unsigned level = 0;
+        bool tree = false;
+        std::vector<unsigned> arcs; // Two arcs in each forest up to the level of a tree edge
+    };
+    std::vector<EulerNode> euler_nodes_;
+    std::vector<unsigned> free_euler_nodes_;
+    std::vector<ConnectivityVertex> connectivity_vertices_;
+    std::vector<unsigned> free_connectivity_vertices_;
+    std::unordered_map<WayID, unsigned> connectivity_edge_ids_;
+    std::vector<ConnectivityEdge> connectivity_edges_;
+    std::vector<unsigned> free_connectivity_edges_;
+
+    RouteAlgorithm route_algorithm_ = RouteAlgorithm::DIJKSTRA;
+    RouteSearch route_search_;
+
+    // Per-worker search state of route_batch, 0 threads means one per hardware thread
+    std::vector<RouteSearch> route_batch_searches_;
+    unsigned route_batch_threads_ = 0;
 
     std::vector<std::shared_ptr<Place>> get_place_vector();
-    std::vector<std::shared_ptr<Area>> find_parent_areas_recursive(std::shared_ptr<Area> area);
-    std::vector<std::shared_ptr<Area>> find_subareas_recursive(std::shared_ptr<Area> area);
-    AreaID find_common_parent_recursive(std::vector<std::shared_ptr<Area>> &parent, std::shared_ptr<Area> area);
+    unsigned find_area_index(AreaID id);
+    void link_area(unsigned area, unsigned parent);
+    void unlink_area(unsigned area);
+    void mark_area_hierarchy_changed();
+    bool use_area_index();
+    bool is_area_in_subtree(unsigned area, unsigned root);
+
+    // visit returning false stops an ancestor walk, enter/leave get (area, depth)
+    template <typename Visit>
+    void walk_area_ancestors(unsigned area, Visit visit) const;
+    template <typename Enter, typename Leave>
+    void walk_area_dfs(unsigned root, AreaWalkBuffers& buffers, Enter enter, Leave leave) const;
+    template <typename Visit>
+    void walk_area_bfs(unsigned root, AreaWalkBuffers& buffers, Visit visit) const;
+
+    void build_area_index();
+    unsigned find_lowest_common_area(unsigned area1, unsigned area2) const;
+
+    // Link-cut tree operations, indices are area indices
+    bool lct_is_splay_root(unsigned node) const;
+    unsigned lct_size(unsigned node) const;
+    void lct_update(unsigned node);
+    void lct_rotate(unsigned node);
+    void lct_splay(unsigned node);
+    unsigned lct_access(unsigned node);
+    unsigned lct_find_root(unsigned node);
+    void lct_link(unsigned node, unsigned parent);
+    void lct_cut(unsigned node);
+    unsigned lct_lowest_common(unsigned node1, unsigned node2);
+
+    // Euler tour tree operations, nodes are indices to euler_nodes_
+    unsigned euler_create(unsigned item, bool arc);
+    void euler_destroy(unsigned node);
+    unsigned euler_crossroads(unsigned node) const;
+    std::uint8_t euler_subtree_flags(unsigned node) const;
+    void euler_update(unsigned node);
+    void euler_rotate(unsigned node);
+    void euler_splay(unsigned node);
+    unsigned euler_join(unsigned left, unsigned right);
+    unsigned euler_detach_left(unsigned node);
+    unsigned euler_detach_right(unsigned node);
+    unsigned euler_build(std::vector<unsigned> const& tour, unsigned begin, unsigned end);
+    unsigned euler_reroot(unsigned node);
+    bool euler_same_tree(unsigned node1, unsigned node2);
+    unsigned euler_find_flag(unsigned root, std::uint8_t flag) const;
+    void euler_set_flag(unsigned node, std::uint8_t flag, bool set);
+
+    // Dynamic connectivity, vertices are crossroad ids and levels index the forests
+    void clear_connectivity();
+    unsigned add_connectivity_vertex();
+    void remove_connectivity_vertex(unsigned vertex);
+    unsigned level_node(unsigned vertex, unsigned level);
+    void link_tree_edge(unsigned edge, unsigned level);
+    void cut_tree_edge(unsigned edge, unsigned level);
+    void add_non_tree_edge(unsigned edge);
+    void remove_non_tree_edge(unsigned edge);
+    unsigned create_connectivity_edge(WayID const& id, unsigned vertex1, unsigned vertex2);
+    void insert_connectivity_edge(WayID const& id, unsigned vertex1, unsigned vertex2);
+    void build_connectivity_forest(std::vector<unsigned> const& edges);
+    void delete_connectivity_edge(WayID const& id);
+    bool find_replacement_edge(unsigned vertex1, unsigned vertex2, unsigned level);
+    bool vertices_connected(unsigned vertex1, unsigned vertex2);
+
+    // Place to area assignment
+    template <typename Visit>
+    void query_area_rtree(AreaRTree const& tree, BoundingBox const& box, Visit visit) const;
+    template <typename Visit>
+    void query_areas_in_box(BoundingBox const& box, Visit visit) const;
+    AreaRTree pack_area_rtree(std::vector<unsigned> items) const;
+    void build_area_rtree();
+    void update_area_rtree();
+    bool is_inner_area(unsigned area, unsigned other) const;
+    unsigned find_innermost_area(Coord xy) const;
+    void assign_all_places();
+    void assign_place(PlaceID id, Coord xy);
+    void unassign_place(PlaceID id);
+    void assign_places_to_new_area(unsigned area);
+    void reassign_places_of_removed_area(unsigned area);
+    void set_place_area(PlaceID id, unsigned area);
+    std::vector<std::pair<Coord, PlaceID>> find_places_in_box(BoundingBox const& box) const;
+    void add_area_place_count(unsigned area, int delta);
+    unsigned count_places_before(unsigned position) const;
+    bool is_area_in_rect(unsigned area, BoundingBox const& rect) const;
+    void build_area_subtree_boxes();
     std::vector<std::shared_ptr<Place>> find_nearest_brute_force(Coord xy, PlaceType type);
 
     // returns distance to power of two to minimize calculations
@@ -280,9 +772,169 @@ private:
 
     Distance calculate_way_length(std::vector<Coord> coords);
 
-    // Pathfinding algorithms
-    std::vector<std::tuple<Coord, WayID, Distance>> astar(Coord c1, Coord c2); // not implemented
-    std::vector<std::tuple<Coord, WayID, Distance>> dfs(Coord c1, Coord c2);
+    // Routing graph
+    void erase_way(std::unordered_map<WayID, std::shared_ptr<Way>>::iterator way);
+    void update_routing_graph();
+    unsigned find_graph_node(Coord xy) const;
+    std::vector<std::tuple<Coord, WayID, Distance>> make_route(unsigned from, unsigned to,
+                                                               std::vector<unsigned> const& parent_edges) const;
+    unsigned edge_source(unsigned edge) const;
+
+    // Pathfinding on graph node ids, read-only apart from the RouteSearch
+    void prepare_route_algorithm(RouteAlgorithm algorithm);
+    std::vector<std::tuple<Coord, WayID, Distance>> find_route(unsigned from, unsigned to, RouteMetric metric,
+                                                               RouteSearch& search) const;
+    std::vector<std::tuple<Coord, WayID, Distance>> shortest_route(unsigned from, unsigned to, RouteAlgorithm algorithm,
+                                                                   RouteSearch& search) const;
+    std::vector<std::tuple<Coord, WayID, Distance>> astar(unsigned from, unsigned to, bool landmarks,
+                                                          RouteSearch& search) const;
+    std::vector<std::tuple<Coord, WayID, Distance>> dfs(unsigned from, unsigned to, RouteSearch& search) const;
+    std::vector<std::tuple<Coord, WayID, Distance>> bfs(unsigned from, unsigned to, RouteSearch& search) const;
+    void bfs_bottom_up(unsigned begin_word, unsigned end_word, unsigned level, RouteSearch& search) const;
+    std::vector<std::tuple<Coord, WayID>> cycle_dfs(unsigned from, RouteSearch& search) const;
+    std::vector<std::tuple<Coord, WayID, Distance>> dijkstra(unsigned from, unsigned to, RouteSearch& search) const;
+    std::vector<std::tuple<Coord, WayID, Distance>> bidirectional_dijkstra(unsigned from, unsigned to,
+                                                                           RouteSearch& search) const;
+    std::vector<std::tuple<Coord, WayID, Distance>> contraction_route(unsigned from, unsigned to,
+                                                                      RouteSearch& search) const;
+    Distance next_route_distance(RadixHeap& heap, RouteWorkspace const& workspace) const;
+    void find_distances(unsigned from, std::vector<unsigned> const& targets, RouteWorkspace& workspace,
+                        RadixHeap& heap) const;
+    std::vector<std::pair<Coord, Distance>> isochrone(unsigned from, Distance max_distance, RouteSearch& search) const;
+
+    // Route cache
+    std::vector<std::tuple<Coord, WayID, Distance>> cached_route(Coord fromxy, Coord toxy, RouteMetric metric);
+    void cache_route(RouteCacheKey const& key, std::vector<std::tuple<Coord, WayID, Distance>> const& route);
+    std::list<RouteCacheEntry>::iterator erase_cached_route(std::list<RouteCacheEntry>::iterator entry);
+    void index_cached_route(RouteCacheEntry const& entry, bool insert);
+    void invalidate_routes_after_add(Way const& way);
+    void invalidate_routes_using(WayID const& id);
+    void clear_route_cache();
+
+    // Landmarks
+    void update_landmarks();
+    void select_landmarks();
+
+    // Contraction hierarchy
+    void build_contraction_hierarchy();
+    void find_shortcuts(unsigned node, ContractionAdjacency const& adjacency, RouteWorkspace& workspace,
+                        RadixHeap& heap, std::vector<std::pair<unsigned, unsigned>>& shortcuts) const;
+    void unpack_contraction_arc(unsigned arc, unsigned from, std::vector<std::tuple<Coord, WayID, Distance>>& route,
+                                Distance& distance) const;
+    void search_upward(unsigned from, RouteWorkspace& workspace, RadixHeap& heap, std::vector<unsigned>& settled) const;
+    std::vector<std::vector<Distance>> contraction_distance_matrix(std::vector<unsigned> const& sources,
+                                                                   std::vector<unsigned> const& targets) const;
 };
 
+template <typename Visit>
+void Datastructures::walk_area_ancestors(unsigned area, Visit visit) const
+{
+    for (unsigned parent = area_parent_[area]; parent != NO_INDEX; parent = area_parent_[parent])
+    {
+        if (!visit(parent))
+        {
+            return;
+        }
+    }
+}
+
+template <typename Enter, typename Leave>
+void Datastructures::walk_area_dfs(unsigned root, AreaWalkBuffers& buffers, Enter enter, Leave leave) const
+{
+    auto& stk = buffers.stack;
+    stk.clear();
+
+    enter(root, 0u);
+    stk.push_back({root, area_first_child_[root]});
+    while (!stk.empty())
+    {
+        unsigned sub = stk.back().second;
+        if (sub != NO_INDEX)
+        {
+            stk.back().second = area_next_sibling_[sub];
+            enter(sub, static_cast<unsigned>(stk.size()));
+            stk.push_back({sub, area_first_child_[sub]});
+        }
+        else
+        {
+            unsigned area = stk.back().first;
+            stk.pop_back();
+            leave(area, static_cast<unsigned>(stk.size()));
+        }
+    }
+}
+
+template <typename Visit>
+void Datastructures::walk_area_bfs(unsigned root, AreaWalkBuffers& buffers, Visit visit) const
+{
+    // The queue is never popped, the front is the read position instead
+    auto& queue = buffers.queue;
+    queue.clear();
+    queue.push_back(root);
+    for (unsigned front = 0; front < queue.size(); ++front)
+    {
+        unsigned area = queue[front];
+        visit(area);
+        for (unsigned sub = area_first_child_[area]; sub != NO_INDEX; sub = area_next_sibling_[sub])
+        {
+            queue.push_back(sub);
+        }
+    }
+}
+
+template <typename Visit>
+void Datastructures::query_area_rtree(AreaRTree const& tree, BoundingBox const& box, Visit visit) const
+{
+    if (tree.items.empty())
+    {
+        return;
+    }
+
+    // Nodes (level, position) whose children still have to be checked
+    std::vector<std::pair<unsigned, unsigned>> stk;
+    stk.reserve(tree.levels.size() * RTREE_FANOUT);
+    stk.push_back({static_cast<unsigned>(tree.levels.size() - 1), 0u});
+    while (!stk.empty())
+    {
+        auto [level, node] = stk.back();
+        stk.pop_back();
+        if (!boxes_intersect(tree.levels[level][node], box))
+        {
+            continue;
+        }
+
+        if (level == 0)
+        {
+            if (area_in_rtree_[tree.items[node]])
+            {
+                visit(tree.items[node]);
+            }
+            continue;
+        }
+
+        unsigned first = node * RTREE_FANOUT;
+        unsigned last = std::min<unsigned>(first + RTREE_FANOUT, tree.levels[level-1].size());
+        for (unsigned child = first; child < last; ++child)
+        {
+            stk.push_back({level - 1, child});
+        }
+    }
+}
+
+template <typename Visit>
+void Datastructures::query_areas_in_box(BoundingBox const& box, Visit visit) const
+{
+    for (unsigned area : area_rtree_pending_)
+    {
+        if (boxes_intersect(area_infos_[area].box, box))
+        {
+            visit(area);
+        }
+    }
+    for (auto const& tree : area_rtrees_)
+    {
+        query_area_rtree(tree, box, visit);
+    }
+}
+
 #endif // DATASTRUCTURES_HH
@@ -477,6 +477,307 @@ void MainProgram::test_all_subareas_in_area()
     }
 }
 
+MainProgram::CmdResult MainProgram::cmd_is_subarea_of(std::ostream &output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
+{
+    string idstr = *begin++;
+    string parentidstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    AreaID id = convert_string_to<AreaID>(idstr);
+    AreaID parentid = convert_string_to<AreaID>(parentidstr);
+
+    bool result = ds_.is_subarea_of(id, parentid);
+    output << "Area "; print_area(id, output, false);
+    output << (result ? " is" : " is not") << " a subarea of "; print_area(parentid, output);
+
+    return {};
+}
+
+void MainProgram::test_is_subarea_of()
+{
+    if (random_areas_added_ > 0) // Don't do anything if there's no places
+    {
+        auto id1 = n_to_areaid(random<decltype(random_areas_added_)>(0, random_areas_added_));
+        auto id2 = n_to_areaid(random<decltype(random_areas_added_)>(0, random_areas_added_));
+        ds_.is_subarea_of(id1, id2);
+    }
+}
+
+MainProgram::CmdResult MainProgram::cmd_remove_area(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    string idstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    AreaID id = convert_string_to<AreaID>(idstr);
+    auto name = ds_.get_area_name(id);
+    bool success = ds_.remove_area(id);
+    if (success)
+    {
+        output << "Area " << name << " removed." << endl;
+        view_dirty = true;
+        return {};
+    }
+    else
+    {
+        return {ResultType::AREAIDLIST, MainProgram::CmdResultAreaIDs{NO_AREA}};
+    }
+}
+
+void MainProgram::test_remove_area()
+{
+    if (random_areas_added_ > 0) // Don't remove if there's nothing to remove
+    {
+        auto id = n_to_areaid(random<decltype(random_areas_added_)>(0, random_areas_added_));
+        ds_.remove_area(id);
+    }
+}
+
+MainProgram::CmdResult MainProgram::cmd_move_subarea(std::ostream& output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
+{
+    string sourceidstr = *begin++;
+    string targetidstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    AreaID sourceid = convert_string_to<AreaID>(sourceidstr);
+    AreaID targetid = convert_string_to<AreaID>(targetidstr);
+
+    view_dirty = true;
+
+    bool ok = ds_.move_subarea(sourceid, targetid);
+    if (ok)
+    {
+        auto sourcename = ds_.get_area_name(sourceid);
+        auto targetname = ds_.get_area_name(targetid);
+        output << "Moved subarea " << sourcename << " to area " << targetname << endl;
+    }
+    else
+    {
+        output << "Moving subarea failed!" << endl;
+    }
+
+    return {};
+}
+
+void MainProgram::test_move_subarea()
+{
+    if (random_areas_added_ > 0) // Don't do anything if there's no areas
+    {
+        auto id1 = n_to_areaid(random<decltype(random_areas_added_)>(0, random_areas_added_));
+        auto id2 = n_to_areaid(random<decltype(random_areas_added_)>(0, random_areas_added_));
+        ds_.move_subarea(id1, id2);
+    }
+}
+
+MainProgram::CmdResult MainProgram::cmd_subarea_count(std::ostream& output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
+{
+    string idstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    AreaID id = convert_string_to<AreaID>(idstr);
+
+    auto result = ds_.subarea_count(id);
+    if (result == NO_VALUE)
+    {
+        return {ResultType::AREAIDLIST, MainProgram::CmdResultAreaIDs{NO_AREA}};
+    }
+
+    output << "Area "; print_area(id, output, false); output << " has " << result << " subareas" << endl;
+    return {};
+}
+
+void MainProgram::test_subarea_count()
+{
+    if (random_areas_added_ > 0) // Don't do anything if there's no areas
+    {
+        auto id = n_to_areaid(random<decltype(random_areas_added_)>(0, random_areas_added_));
+        ds_.subarea_count(id);
+    }
+}
+
+MainProgram::CmdResult MainProgram::cmd_area_of_place(std::ostream& output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
+{
+    string idstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    PlaceID id = convert_string_to<PlaceID>(idstr);
+
+    auto result = ds_.area_of_place(id);
+    if (result == NO_AREA)
+    {
+        output << "Place is not in any area" << endl;
+        return {};
+    }
+
+    output << "Place "; print_place(id, output, false); output << " is in area:" << endl;
+    return {ResultType::AREAIDLIST, MainProgram::CmdResultAreaIDs{result}};
+}
+
+void MainProgram::test_area_of_place()
+{
+    if (random_places_added_ > 0) // Don't do anything if there's no places
+    {
+        PlaceID id = n_to_placeid(random<decltype(random_places_added_)>(0, random_places_added_));
+        ds_.area_of_place(id);
+    }
+}
+
+MainProgram::CmdResult MainProgram::cmd_places_in_area(std::ostream& output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
+{
+    string idstr = *begin++;
+    string recursivestr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    AreaID id = convert_string_to<AreaID>(idstr);
+    bool recursive = !recursivestr.empty();
+
+    auto result = ds_.places_in_area(id, recursive);
+    if (result.size() == 1 && result.front() == NO_PLACE)
+    {
+        return {ResultType::AREAIDLIST, MainProgram::CmdResultAreaIDs{NO_AREA}};
+    }
+    if (result.empty())
+    {
+        output << "No Places!" << std::endl;
+    }
+
+    sort(result.begin(), result.end());
+    return {ResultType::PLACEIDLIST, CmdResultPlaceIDs{id, result}};
+}
+
+void MainProgram::test_places_in_area()
+{
+    if (random_areas_added_ > 0) // Don't do anything if there's no areas
+    {
+        auto id = n_to_areaid(random<decltype(random_areas_added_)>(0, random_areas_added_));
+        ds_.places_in_area(id, random(0, 2) == 1);
+    }
+}
+
+MainProgram::CmdResult MainProgram::cmd_place_count_in_area(std::ostream& output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
+{
+    string idstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    AreaID id = convert_string_to<AreaID>(idstr);
+
+    auto result = ds_.place_count_in_area(id);
+    if (result == NO_VALUE)
+    {
+        return {ResultType::AREAIDLIST, MainProgram::CmdResultAreaIDs{NO_AREA}};
+    }
+
+    output << "Area "; print_area(id, output, false); output << " and its subareas have " << result << " places" << endl;
+    return {};
+}
+
+void MainProgram::test_place_count_in_area()
+{
+    if (random_areas_added_ > 0) // Don't do anything if there's no areas
+    {
+        auto id = n_to_areaid(random<decltype(random_areas_added_)>(0, random_areas_added_));
+        ds_.place_count_in_area(id);
+    }
+}
+
+MainProgram::CmdResult MainProgram::cmd_area_info(std::ostream& output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
+{
+    string idstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    AreaID id = convert_string_to<AreaID>(idstr);
+
+    auto info = ds_.area_info(id);
+    if (info.box.min == NO_COORD)
+    {
+        return {ResultType::AREAIDLIST, MainProgram::CmdResultAreaIDs{NO_AREA}};
+    }
+
+    output << "Area "; print_area(id, output, false); output << ":" << endl;
+    output << "  bounding box "; print_coord(info.box.min, output, false);
+    output << "-"; print_coord(info.box.max, output);
+    output << "  with subareas "; print_coord(info.subtree_box.min, output, false);
+    output << "-"; print_coord(info.subtree_box.max, output);
+    output << "  signed area " << info.signed_area << ", perimeter " << info.perimeter << endl;
+    output << "  centroid (" << info.centroid_x << "," << info.centroid_y << "), "
+           << (info.convex ? "convex" : "not convex") << endl;
+    return {};
+}
+
+void MainProgram::test_area_info()
+{
+    if (random_areas_added_ > 0) // Don't do anything if there's no areas
+    {
+        auto id = n_to_areaid(random<decltype(random_areas_added_)>(0, random_areas_added_));
+        ds_.area_info(id);
+    }
+}
+
+MainProgram::CmdResult MainProgram::cmd_areas_in_rect(std::ostream& output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
+{
+    string minxstr = *begin++;
+    string minystr = *begin++;
+    string maxxstr = *begin++;
+    string maxystr = *begin++;
+    string rootstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    Coord min = {convert_string_to<int>(minxstr), convert_string_to<int>(minystr)};
+    Coord max = {convert_string_to<int>(maxxstr), convert_string_to<int>(maxystr)};
+
+    std::vector<AreaID> result;
+    if (rootstr.empty())
+    {
+        result = ds_.areas_in_rect({min, max});
+    }
+    else
+    {
+        result = ds_.areas_in_rect({min, max}, convert_string_to<AreaID>(rootstr));
+        if (result.size() == 1 && result.front() == NO_AREA)
+        {
+            return {ResultType::AREAIDLIST, MainProgram::CmdResultAreaIDs{NO_AREA}};
+        }
+    }
+    if (result.empty())
+    {
+        output << "No areas!" << endl;
+    }
+
+    sort(result.begin(), result.end());
+    return {ResultType::AREAIDLIST, MainProgram::CmdResultAreaIDs{result}};
+}
+
+void MainProgram::test_areas_in_rect()
+{
+    // Rectangles are a hundredth of the default random coordinate range wide
+    int x = random<int>(1, 9900);
+    int y = random<int>(1, 9900);
+    ds_.areas_in_rect({{x, y}, {x + 100, y + 100}});
+}
+
+MainProgram::CmdResult MainProgram::cmd_overlapping_areas(std::ostream& output, MainProgram::MatchIter /*begin*/, MainProgram::MatchIter /*end*/)
+{
+    auto result = ds_.overlapping_areas();
+    if (result.empty())
+    {
+        output << "No overlapping areas!" << endl;
+        return {};
+    }
+
+    unsigned int num = 0;
+    for (auto& [id1, id2] : result)
+    {
+        ++num;
+        output << num << ". "; print_area(id1, output, false);
+        output << " overlaps "; print_area(id2, output);
+    }
+    return {};
+}
+
+void MainProgram::test_overlapping_areas()
+{
+    ds_.overlapping_areas();
+}
+
 MainProgram::CmdResult MainProgram::cmd_places_closest_to(std::ostream& /*output*/, MainProgram::MatchIter begin, MainProgram::MatchIter end)
 {
   string xstr = *begin++;
@@ -536,6 +837,71 @@ void MainProgram::test_common_area_of_subareas()
     }
 }
 
+MainProgram::CmdResult MainProgram::cmd_common_area_of_many(std::ostream &output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
+{
+    string idsstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto ids = parse_area_ids(idsstr);
+
+    auto result = ds_.common_area_of_many(ids);
+    if (result == NO_AREA)
+    {
+        output << "No common area found!" << endl;
+        return {};
+    }
+
+    output << "Common area of " << ids.size() << " areas is:" << endl;
+    return {ResultType::AREAIDLIST, CmdResultAreaIDs{{result}}};
+}
+
+void MainProgram::test_common_area_of_many()
+{
+    if (random_areas_added_ > 0) // Don't do anything if there's no places
+    {
+        ds_.common_area_of_many(random_area_ids(10));
+    }
+}
+
+MainProgram::CmdResult MainProgram::cmd_subarea_in_areas_batch(std::ostream &output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
+{
+    string idsstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto ids = parse_area_ids(idsstr);
+
+    auto result = ds_.subarea_in_areas_batch(ids);
+    for (unsigned int i = 0; i < ids.size() && i < result.size(); ++i)
+    {
+        output << "Area hierarchy for area ";
+        print_area(ids[i], output);
+
+        auto& areas = result[i];
+        if (areas.empty()) { output << "Area is not a subarea of any area." << endl; }
+        else if (areas.size() == 1 && areas.front() == NO_AREA) { output << "Failed (NO_... returned)!!" << endl; }
+        else
+        {
+            unsigned int num = 0;
+            for (auto area : areas)
+            {
+                ++num;
+                output << num << ". ";
+                print_area(area, output);
+            }
+        }
+    }
+
+    return {};
+}
+
+void MainProgram::test_subarea_in_areas_batch()
+{
+    if (random_areas_added_ > 0) // Don't do anything if there's no places
+    {
+        ds_.subarea_in_areas_batch(random_area_ids(10));
+    }
+}
+
 MainProgram::CmdResult MainProgram::cmd_all_ways(std::ostream &output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
 {
     assert( begin == end && "Impossible number of parameters!");
@@ -1149,6 +1515,29 @@ std::string MainProgram::print_coord(Coord coord, std::ostream& output, bool nl)
     }
 }
 
+std::vector<AreaID> MainProgram::parse_area_ids(std::string const& idsstr)
+{
+    vector<AreaID> ids;
+    smatch id;
+    auto sbeg = idsstr.cbegin();
+    auto send = idsstr.cend();
+    for ( ; regex_search(sbeg, send, id, sizes_regex_); sbeg = id.suffix().first)
+    {
+        ids.push_back(convert_string_to<AreaID>(id[1]));
+    }
+    return ids;
+}
+
+std::vector<AreaID> MainProgram::random_area_ids(unsigned int count)
+{
+    vector<AreaID> ids;
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        ids.push_back(n_to_areaid(random<decltype(random_areas_added_)>(0, random_areas_added_)));
+    }
+    return ids;
+}
+
 MainProgram::CmdResult MainProgram::cmd_find_places_name(std::ostream& output, MatchIter begin, MatchIter end)
 {
     string name = *begin++;
@@ -1329,6 +1718,192 @@ void MainProgram::test_route_shortest_distance()
     ds_.route_shortest_distance(coord1, coord2);
 }
 
+MainProgram::CmdResult MainProgram::cmd_route_algorithm(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    string algorithmstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    RouteAlgorithm algorithm = convert_string_to_routealgorithm(algorithmstr);
+    ds_.set_route_algorithm(algorithm);
+
+    output << "Shortest routes are searched with " << convert_routealgorithm_to_string(algorithm) << endl;
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_prepare_routing(std::ostream& output, MatchIter /*begin*/, MatchIter /*end*/)
+{
+    ds_.prepare_routing();
+
+    output << "Routing prepared" << endl;
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_parallel_bfs(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    string onoffstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    bool parallel = (onoffstr == "on");
+    ds_.set_parallel_bfs(parallel);
+
+    output << "Least crossroads routes expand bottom-up levels " << (parallel ? "in parallel" : "on one thread") << endl;
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_cache_stats(std::ostream& output, MatchIter /*begin*/, MatchIter /*end*/)
+{
+    auto stats = ds_.route_cache_stats();
+    auto lookups = stats.hits + stats.misses;
+
+    output << "Route cache has " << stats.entries << " routes in " << stats.bytes << " bytes" << endl;
+    output << "  hits " << stats.hits << ", misses " << stats.misses;
+    if (lookups > 0)
+    {
+        output << ", hit rate " << 100.0 * stats.hits / lookups << "%";
+    }
+    output << endl;
+    output << "  evicted " << stats.evictions << ", invalidated " << stats.invalidations << endl;
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_route_batch(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    string metricstr = *begin++;
+    string coordsstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    RouteMetric metric = convert_string_to_routemetric(metricstr);
+    vector<Coord> coords;
+    smatch coord;
+    auto sbeg = coordsstr.cbegin();
+    auto send = coordsstr.cend();
+    for ( ; regex_search(sbeg, send, coord, coords_regex_); sbeg = coord.suffix().first)
+    {
+        coords.push_back({convert_string_to<int>(coord[1]),convert_string_to<int>(coord[2])});
+    }
+    if (coords.size() % 2 != 0)
+    {
+        output << "Coordinates must be given in pairs!" << endl;
+        return {};
+    }
+
+    vector<pair<Coord, Coord>> queries;
+    for (unsigned int i = 0; i < coords.size(); i += 2)
+    {
+        queries.emplace_back(coords[i], coords[i+1]);
+    }
+
+    auto routes = ds_.route_batch(metric, queries);
+    for (unsigned int i = 0; i < queries.size(); ++i)
+    {
+        auto const& route = routes[i];
+        output << i+1 << ". ";
+        print_coord(queries[i].first, output, false);
+        output << " to ";
+        print_coord(queries[i].second, output, false);
+        output << ": ";
+        if (route.empty())
+        {
+            output << "No route found!" << endl;
+        }
+        else if (route.front() == make_tuple(NO_COORD, NO_WAY, NO_DISTANCE))
+        {
+            output << "Starting or destination coord has no ways!" << endl;
+        }
+        else
+        {
+            output << route.size()-1 << " ways, distance " << std::get<2>(route.back()) << endl;
+        }
+    }
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_distance_matrix(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    string sourcesstr = *begin++;
+    string targetsstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto read_coords = [this](string const& coordsstr)
+    {
+        vector<Coord> coords;
+        smatch coord;
+        auto sbeg = coordsstr.cbegin();
+        auto send = coordsstr.cend();
+        for ( ; regex_search(sbeg, send, coord, coords_regex_); sbeg = coord.suffix().first)
+        {
+            coords.push_back({convert_string_to<int>(coord[1]),convert_string_to<int>(coord[2])});
+        }
+        return coords;
+    };
+    auto sources = read_coords(sourcesstr);
+    auto targets = read_coords(targetsstr);
+
+    auto matrix = ds_.distance_matrix(sources, targets);
+    for (unsigned source = 0; source < sources.size(); ++source)
+    {
+        print_coord(sources[source], output, false);
+        output << ":";
+        for (auto distance : matrix[source])
+        {
+            output << ' ';
+            if (distance == NO_DISTANCE) { output << "-"; }
+            else { output << distance; }
+        }
+        output << endl;
+    }
+    return {};
+}
+
+void MainProgram::test_distance_matrix()
+{
+    // Choose ten random sources and targets
+    vector<Coord> sources;
+    vector<Coord> targets;
+    for (unsigned i = 0; i < 10; ++i)
+    {
+        sources.push_back(n_to_coord(random(decltype(random_ways_added_)(0),random_ways_added_)));
+        targets.push_back(n_to_coord(random(decltype(random_ways_added_)(0),random_ways_added_)));
+    }
+
+    ds_.distance_matrix(sources, targets);
+}
+
+MainProgram::CmdResult MainProgram::cmd_route_expansions(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    string fromxstr = *begin++;
+    string fromystr = *begin++;
+    string toxstr = *begin++;
+    string toystr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    Coord fromxy = {convert_string_to<int>(fromxstr),convert_string_to<int>(fromystr)};
+    Coord toxy = {convert_string_to<int>(toxstr),convert_string_to<int>(toystr)};
+
+    for (auto algorithm : {RouteAlgorithm::DIJKSTRA, RouteAlgorithm::ASTAR, RouteAlgorithm::BIDIRECTIONAL,
+                           RouteAlgorithm::CONTRACTION, RouteAlgorithm::LANDMARKS})
+    {
+        auto expanded = ds_.route_search_expansions(fromxy, toxy, algorithm);
+        if (expanded == NO_VALUE)
+        {
+            output << "Starting or destination coord has no ways!" << endl;
+            return {};
+        }
+        output << convert_routealgorithm_to_string(algorithm) << " expanded " << expanded << " crossroads" << endl;
+    }
+
+    return {};
+}
+
+void MainProgram::test_route_expansions()
+{
+    // Choose two random places
+    Coord coord1 = n_to_coord(random(decltype(random_ways_added_)(0),random_ways_added_));
+    Coord coord2 = n_to_coord(random(decltype(random_ways_added_)(0),random_ways_added_));
+
+    ds_.route_search_expansions(coord1, coord2, RouteAlgorithm::ASTAR);
+}
+
 MainProgram::CmdResult MainProgram::cmd_route_least_crossroads(std::ostream& output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
 {
     string fromxstr = *begin++;
@@ -1470,6 +2045,118 @@ void MainProgram::test_trim_ways()
     ds_.trim_ways();
 }
 
+MainProgram::CmdResult MainProgram::cmd_connected(std::ostream &output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
+{
+    string x1str = *begin++;
+    string y1str = *begin++;
+    string x2str = *begin++;
+    string y2str = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    Coord xy1 = {convert_string_to<int>(x1str),convert_string_to<int>(y1str)};
+    Coord xy2 = {convert_string_to<int>(x2str),convert_string_to<int>(y2str)};
+
+    bool result = ds_.connected(xy1, xy2);
+    output << "Crossroads "; print_coord(xy1, output, false);
+    output << " and "; print_coord(xy2, output, false);
+    output << (result ? " are" : " are not") << " connected" << endl;
+
+    return {};
+}
+
+void MainProgram::test_connected()
+{
+    // Choose two random crossroads
+    Coord coord1 = n_to_coord(random(decltype(random_ways_added_)(0),random_ways_added_));
+    Coord coord2 = n_to_coord(random(decltype(random_ways_added_)(0),random_ways_added_));
+
+    ds_.connected(coord1, coord2);
+}
+
+MainProgram::CmdResult MainProgram::cmd_reachable_within(std::ostream &output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
+{
+    string xstr = *begin++;
+    string ystr = *begin++;
+    string diststr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    Coord xy = {convert_string_to<int>(xstr),convert_string_to<int>(ystr)};
+    Distance max_distance = convert_string_to<Distance>(diststr);
+
+    auto reached = ds_.reachable_within(xy, max_distance);
+    if (!reached.empty() && reached.front() == std::make_pair(NO_COORD, NO_DISTANCE))
+    {
+        output << "Starting coord has no ways!" << endl;
+        return {};
+    }
+
+    // Crossroads at the same distance can come in any order
+    std::sort(reached.begin(), reached.end(), [](auto const& r1, auto const& r2)
+              { return std::tie(r1.second, r1.first) < std::tie(r2.second, r2.first); });
+    unsigned int num = 0;
+    for (auto const& [coord, dist] : reached)
+    {
+        ++num;
+        output << num << ". ";
+        print_coord(coord, output, false);
+        output << " distance " << dist << endl;
+    }
+
+    return {};
+}
+
+void MainProgram::test_reachable_within()
+{
+    Coord coord = n_to_coord(random(decltype(random_ways_added_)(0),random_ways_added_));
+    Distance max_distance = random<Distance>(0, 1000);
+
+    ds_.reachable_within(coord, max_distance);
+}
+
+MainProgram::CmdResult MainProgram::cmd_places_reachable_within(std::ostream &output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
+{
+    string xstr = *begin++;
+    string ystr = *begin++;
+    string diststr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    Coord xy = {convert_string_to<int>(xstr),convert_string_to<int>(ystr)};
+    Distance max_distance = convert_string_to<Distance>(diststr);
+
+    auto places = ds_.places_reachable_within(xy, max_distance);
+    if (!places.empty() && places.front() == std::make_pair(NO_PLACE, NO_DISTANCE))
+    {
+        output << "Starting coord has no ways!" << endl;
+        return {};
+    }
+    if (places.empty())
+    {
+        output << "No places within distance " << max_distance << endl;
+        return {};
+    }
+
+    std::sort(places.begin(), places.end(), [](auto const& p1, auto const& p2)
+              { return std::tie(p1.second, p1.first) < std::tie(p2.second, p2.first); });
+    unsigned int num = 0;
+    for (auto const& [id, dist] : places)
+    {
+        ++num;
+        output << num << ". ";
+        print_place(id, output, false);
+        output << ", distance " << dist << endl;
+    }
+
+    return {};
+}
+
+void MainProgram::test_places_reachable_within()
+{
+    Coord coord = n_to_coord(random(decltype(random_ways_added_)(0),random_ways_added_));
+    Distance max_distance = random<Distance>(0, 1000);
+
+    ds_.places_reachable_within(coord, max_distance);
+}
+
 MainProgram::CmdResult MainProgram::cmd_clear_ways(std::ostream& output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
 {
     assert( begin == end && "Impossible number of parameters!");
@@ -1509,12 +2196,23 @@ vector<MainProgram::CmdInfo> MainProgram::cmds_ =
     {"places_coord_order", "", "", &MainProgram::NoParPlaceListCmd<&Datastructures::places_coord_order>, &MainProgram::NoParPlaceListTestCmd<&Datastructures::places_coord_order> },
     {"places_closest_to", "Coord [type] (type optional)", coordx+"(?:"+wsx+typex+")?", &MainProgram::cmd_places_closest_to, &MainProgram::test_places_closest_to },
     {"common_area_of_subareas", "ID1 ID2", plcidx+wsx+plcidx, &MainProgram::cmd_common_area_of_subareas, &MainProgram::test_common_area_of_subareas },
+    {"common_area_of_many", "ID1 ID2...", "([0-9]+(?:"+wsx+"[0-9]+)*)", &MainProgram::cmd_common_area_of_many, &MainProgram::test_common_area_of_many },
+    {"subarea_in_areas_batch", "AreaID1 AreaID2...", "([0-9]+(?:"+wsx+"[0-9]+)*)", &MainProgram::cmd_subarea_in_areas_batch, &MainProgram::test_subarea_in_areas_batch },
     {"remove_place", "ID", plcidx, &MainProgram::cmd_remove_place, &MainProgram::test_remove_place },
     {"find_places_name", "'Name'", namex, &MainProgram::cmd_find_places_name, &MainProgram::test_find_places_name },
     {"find_places_type", "type", typex, &MainProgram::cmd_find_places_type, &MainProgram::test_find_places_type },
     {"change_place_name", "ID 'Newname'", plcidx+wsx+namex, &MainProgram::cmd_change_place_name, &MainProgram::test_change_place_name },
     {"change_place_coord", "ID (x,y)", plcidx+wsx+coordx, &MainProgram::cmd_change_place_coord, &MainProgram::test_change_place_coord },
     {"add_subarea_to_area", "SubareaID AreaID", areaidx+wsx+areaidx, &MainProgram::cmd_add_subarea_to_area, nullptr },
+    {"move_subarea", "SubareaID AreaID", areaidx+wsx+areaidx, &MainProgram::cmd_move_subarea, &MainProgram::test_move_subarea },
+    {"remove_area", "AreaID", areaidx, &MainProgram::cmd_remove_area, &MainProgram::test_remove_area },
+    {"subarea_count", "AreaID", areaidx, &MainProgram::cmd_subarea_count, &MainProgram::test_subarea_count },
+    {"area_of_place", "ID", plcidx, &MainProgram::cmd_area_of_place, &MainProgram::test_area_of_place },
+    {"places_in_area", "AreaID [recursive] (recursive optional)", areaidx+"(?:"+wsx+"(recursive))?", &MainProgram::cmd_places_in_area, &MainProgram::test_places_in_area },
+    {"place_count_in_area", "AreaID", areaidx, &MainProgram::cmd_place_count_in_area, &MainProgram::test_place_count_in_area },
+    {"area_info", "AreaID", areaidx, &MainProgram::cmd_area_info, &MainProgram::test_area_info },
+    {"areas_in_rect", "(minx,miny) (maxx,maxy) [AreaID] (AreaID optional)", coordx+wsx+coordx+"(?:"+wsx+areaidx+")?", &MainProgram::cmd_areas_in_rect, &MainProgram::test_areas_in_rect },
+    {"overlapping_areas", "", "", &MainProgram::cmd_overlapping_areas, &MainProgram::test_overlapping_areas },
     {"all_ways", "", "", &MainProgram::cmd_all_ways, nullptr },
     {"add_way", "WayID (x,y) (x,y)...", wayidx+"((?:"+wsx+optcoordx+")+)", &MainProgram::cmd_add_way, nullptr },
     {"random_ways", "number_of_ways_to_add", numx,
@@ -1525,17 +2223,33 @@ vector<MainProgram::CmdInfo> MainProgram::cmds_ =
     {"remove_way", "WayID", wayidx, &MainProgram::cmd_remove_way, &MainProgram::test_remove_way },
     {"subarea_in_areas", "AreaID", areaidx, &MainProgram::cmd_subarea_in_areas, &MainProgram::test_subarea_in_areas },
     {"all_subareas_in_area", "AreaID", areaidx, &MainProgram::cmd_all_subareas_in_area, &MainProgram::test_all_subareas_in_area },
+    {"is_subarea_of", "SubareaID AreaID", areaidx+wsx+areaidx, &MainProgram::cmd_is_subarea_of, &MainProgram::test_is_subarea_of },
     {"route_any", "CoordFrom CoordTo", coordx+wsx+coordx, &MainProgram::cmd_route_any, &MainProgram::test_route_any },
     {"route_least_crossroads", "CoordFrom CoordTo", coordx+wsx+coordx, &MainProgram::cmd_route_least_crossroads, &MainProgram::test_route_least_crossroads },
     {"route_shortest_distance", "CoordFrom CoordTo", coordx+wsx+coordx, &MainProgram::cmd_route_shortest_distance, &MainProgram::test_route_shortest_distance },
     {"route_with_cycle", "Coordfrom", coordx, &MainProgram::cmd_route_with_cycle, &MainProgram::test_route_with_cycle },
+    {"route_algorithm", "dijkstra/astar/bidirectional/contraction/landmarks", typex, &MainProgram::cmd_route_algorithm, nullptr },
+    {"prepare_routing", "", "", &MainProgram::cmd_prepare_routing, nullptr },
+    {"parallel_bfs", "on/off", "(on|off)", &MainProgram::cmd_parallel_bfs, nullptr },
+    {"cache_stats", "", "", &MainProgram::cmd_cache_stats, nullptr },
+    {"route_batch", "any|least_crossroads|shortest_distance CoordFrom CoordTo [CoordFrom CoordTo...]",
+     "(any|least_crossroads|shortest_distance)"+wsx+"("+optcoordx+"(?:"+wsx+optcoordx+")*)", &MainProgram::cmd_route_batch, nullptr },
+    {"distance_matrix", "(x,y)... to (x,y)...", "("+optcoordx+"(?:"+wsx+optcoordx+")*)"+wsx+"to"+wsx+"("+optcoordx+"(?:"+wsx+optcoordx+")*)",
+     &MainProgram::cmd_distance_matrix, &MainProgram::test_distance_matrix },
+    {"route_expansions", "CoordFrom CoordTo", coordx+wsx+coordx, &MainProgram::cmd_route_expansions, &MainProgram::test_route_expansions },
     {"trim_ways", "", "", &MainProgram::cmd_trim_ways, &MainProgram::test_trim_ways },
+    {"connected", "Coord1 Coord2", coordx+wsx+coordx, &MainProgram::cmd_connected, &MainProgram::test_connected },
+    {"reachable_within", "Coord Distance", coordx+wsx+numx, &MainProgram::cmd_reachable_within, &MainProgram::test_reachable_within },
+    {"places_reachable_within", "Coord Distance", coordx+wsx+numx, &MainProgram::cmd_places_reachable_within, &MainProgram::test_places_reachable_within },
     {"quit", "", "", nullptr, nullptr },
     {"help", "", "", &MainProgram::help_command, nullptr },
     {"read", "\"in-filename\" [silent]", "\"([-a-zA-Z0-9 ./:_]+)\"(?:"+wsx+"(silent))?", &MainProgram::cmd_read, nullptr },
     {"testread", "\"in-filename\" \"out-filename\"", "\"([-a-zA-Z0-9 ./:_]+)\""+wsx+"\"([-a-zA-Z0-9 ./:_]+)\"", &MainProgram::cmd_testread, nullptr },
     {"perftest", "cmd1|all|compulsory[;cmd2...] timeout repeat_count n1[;n2...] (parts in [] are optional, alternatives separated by |)",
      "([0-9a-zA-Z_]+(?:;[0-9a-zA-Z_]+)*)"+wsx+numx+wsx+numx+wsx+"([0-9]+(?:;[0-9]+)*)", &MainProgram::cmd_perftest, nullptr },
+    {"perftest_batch", "any|least_crossroads|shortest_distance ways queries threads1[;threads2...] (alternatives separated by |)",
+     "(any|least_crossroads|shortest_distance)"+wsx+numx+wsx+numx+wsx+"([0-9]+(?:;[0-9]+)*)", &MainProgram::cmd_perftest_batch, nullptr },
+    {"perftest_cycle", "queries n1[;n2...]", numx+wsx+"([0-9]+(?:;[0-9]+)*)", &MainProgram::cmd_perftest_cycle, nullptr },
     {"stopwatch", "on|off|next (alternatives separated by |)", "(?:(on)|(off)|(next))", &MainProgram::cmd_stopwatch, nullptr },
     {"random_seed", "new-random-seed-integer", numx, &MainProgram::cmd_randseed, nullptr },
     {"#", "comment text", ".*", &MainProgram::cmd_comment, nullptr },
@@ -1559,8 +2273,11 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
 #endif // _GLIBCXX_DEBUG
 
     vector<string> optional_cmds({"places_closest_to", "places_common_area", "route_least_crossroads", "route_with_cycle", "route_shortest_distance",
-                                  "add_walking_connections"});
-    vector<string> nondefault_cmds({"remove_place", "find_places", "way_coords"});
+                                  "add_walking_connections", "is_subarea_of", "common_area_of_many", "subarea_in_areas_batch",
+                                  "move_subarea", "subarea_count", "area_of_place", "places_in_area", "place_count_in_area",
+                                  "area_info", "areas_in_rect", "overlapping_areas", "route_expansions", "distance_matrix", "connected",
+                                  "reachable_within", "places_reachable_within"});
+    vector<string> nondefault_cmds({"remove_place", "find_places", "way_coords", "remove_area"});
 
     string commandstr = *begin++;
     unsigned int timeout = convert_string_to<unsigned int>(*begin++);
@@ -1812,6 +2529,114 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
     return {};
 }
 
+MainProgram::CmdResult MainProgram::cmd_perftest_batch(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    string metricstr = *begin++;
+    unsigned int way_count = convert_string_to<unsigned int>(*begin++);
+    unsigned int query_count = convert_string_to<unsigned int>(*begin++);
+    string threadsstr = *begin++;
+    assert(begin == end && "Invalid number of parameters");
+
+    RouteMetric metric = convert_string_to_routemetric(metricstr);
+    vector<unsigned int> thread_counts;
+    smatch threads;
+    auto tbeg = threadsstr.cbegin();
+    auto tend = threadsstr.cend();
+    for ( ; regex_search(tbeg, tend, threads, sizes_regex_); tbeg = threads.suffix().first)
+    {
+        thread_counts.push_back(convert_string_to<unsigned int>(threads[1]));
+    }
+
+    ds_.clear_all();
+    ds_.clear_ways();
+    init_primes();
+    add_random_ways(way_count);
+
+    vector<pair<Coord, Coord>> queries;
+    for (unsigned int i = 0; i < query_count; ++i)
+    {
+        Coord coord1 = n_to_coord(random(decltype(random_ways_added_)(0),random_ways_added_));
+        Coord coord2 = n_to_coord(random(decltype(random_ways_added_)(0),random_ways_added_));
+        queries.emplace_back(coord1, coord2);
+    }
+
+    // A first batch builds the routing graph and any preprocessing, so that
+    // the timed batches measure only the queries
+    ds_.route_batch(metric, {});
+
+    output << "Batch of " << query_count << " " << convert_routemetric_to_string(metric) << " routes over "
+           << way_count << " random ways" << endl;
+    output << setw(7) << "threads" << " , " << setw(12) << "batch (sec)" << " , " << setw(12) << "queries/sec" << endl;
+    flush_output(output);
+    for (unsigned int thread_count : thread_counts)
+    {
+        ds_.set_route_batch_threads(thread_count);
+        Stopwatch stopwatch;
+        stopwatch.start();
+        ds_.route_batch(metric, queries);
+        stopwatch.stop();
+
+        auto sec = stopwatch.elapsed();
+        output << setw(7) << thread_count << " , " << setw(12) << sec << " , " << setw(12) << query_count / sec << endl;
+        flush_output(output);
+        if (check_stop())
+        {
+            output << "Stopped!" << endl;
+            break;
+        }
+    }
+    ds_.set_route_batch_threads(0);
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_perftest_cycle(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    unsigned int query_count = convert_string_to<unsigned int>(*begin++);
+    string sizes = *begin++;
+    assert(begin == end && "Invalid number of parameters");
+
+    vector<unsigned int> init_ns;
+    smatch size;
+    auto sbeg = sizes.cbegin();
+    auto send = sizes.cend();
+    for ( ; regex_search(sbeg, send, size, sizes_regex_); sbeg = size.suffix().first)
+    {
+        init_ns.push_back(convert_string_to<unsigned int>(size[1]));
+    }
+
+    output << "For each N add N random ways and perform " << query_count << " route_with_cycle queries from random coords" << endl;
+    output << setw(7) << "N" << " , " << setw(12) << "cmds (sec)" << " , " << setw(12) << "usec/query" << endl;
+    flush_output(output);
+    for (unsigned int n : init_ns)
+    {
+        ds_.clear_all();
+        ds_.clear_ways();
+        init_primes();
+        add_random_ways(n);
+
+        // The first query builds the routing graph, like the first click on a new map
+        test_route_with_cycle();
+
+        Stopwatch stopwatch;
+        stopwatch.start();
+        for (unsigned int i = 0; i < query_count; ++i)
+        {
+            test_route_with_cycle();
+        }
+        stopwatch.stop();
+
+        auto sec = stopwatch.elapsed();
+        output << setw(7) << n << " , " << setw(12) << sec << " , " << setw(12) << sec * 1e6 / std::max(1u, query_count) << endl;
+        flush_output(output);
+        if (check_stop())
+        {
+            output << "Stopped!" << endl;
+            break;
+        }
+    }
+    return {};
+}
+
 MainProgram::CmdResult MainProgram::cmd_comment(std::ostream& /*output*/, MatchIter /*begin*/, MatchIter /*end*/)
 {
     return {};
@@ -2184,6 +3009,63 @@ std::string MainProgram::convert_placetype_to_string(PlaceType type)
     }
 }
 
+RouteMetric MainProgram::convert_string_to_routemetric(std::string from)
+{
+    if (from == "any") { return RouteMetric::ANY; }
+    else if (from == "least_crossroads") { return RouteMetric::LEAST_CROSSROADS; }
+    else if (from == "shortest_distance") { return RouteMetric::SHORTEST_DISTANCE; }
+    else
+    {
+        throw std::invalid_argument("Cannot convert string to route metric");
+    }
+}
+
+std::string MainProgram::convert_routemetric_to_string(RouteMetric metric)
+{
+    switch (metric)
+    {
+    case RouteMetric::ANY:
+        return "any";
+    case RouteMetric::LEAST_CROSSROADS:
+        return "least_crossroads";
+    case RouteMetric::SHORTEST_DISTANCE:
+        return "shortest_distance";
+    default:
+        return "!!no metric!!";
+    }
+}
+
+RouteAlgorithm MainProgram::convert_string_to_routealgorithm(std::string from)
+{
+    if (from == "dijkstra") { return RouteAlgorithm::DIJKSTRA; }
+    else if (from == "astar") { return RouteAlgorithm::ASTAR; }
+    else if (from == "bidirectional") { return RouteAlgorithm::BIDIRECTIONAL; }
+    else if (from == "contraction") { return RouteAlgorithm::CONTRACTION; }
+    else if (from == "landmarks") { return RouteAlgorithm::LANDMARKS; }
+    else
+    {
+        throw std::invalid_argument("Cannot convert string to route algorithm");
+    }
+}
+
+std::string MainProgram::convert_routealgorithm_to_string(RouteAlgorithm algorithm)
+{
+    switch (algorithm)
+    {
+    case RouteAlgorithm::DIJKSTRA:
+        return "dijkstra";
+    case RouteAlgorithm::ASTAR:
+        return "astar";
+    case RouteAlgorithm::BIDIRECTIONAL:
+        return "bidirectional";
+    case RouteAlgorithm::CONTRACTION:
+        return "contraction";
+    case RouteAlgorithm::LANDMARKS:
+        return "landmarks";
+    default:
+        return "!!no algorithm!!";
+    }
+}
 
 void MainProgram::init_primes()
 {
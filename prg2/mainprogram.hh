@@ -124,8 +124,20 @@ private:
     CmdResult cmd_add_subarea_to_area(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_subarea_in_areas(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_all_subareas_in_area(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_is_subarea_of(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_remove_area(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_move_subarea(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_subarea_count(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_area_of_place(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_places_in_area(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_place_count_in_area(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_area_info(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_areas_in_rect(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_overlapping_areas(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_places_closest_to(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_common_area_of_subareas(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_common_area_of_many(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_subarea_in_areas_batch(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_all_ways(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_add_way(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_ways_from(std::ostream& output, MatchIter begin, MatchIter end);
@@ -136,8 +148,18 @@ private:
     CmdResult cmd_remove_way(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_route_least_crossroads(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_route_shortest_distance(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_route_algorithm(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_prepare_routing(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_parallel_bfs(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_cache_stats(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_route_batch(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_distance_matrix(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_route_expansions(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_route_with_cycle(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_trim_ways(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_connected(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_reachable_within(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_places_reachable_within(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_random_add(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_random_ways(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_randseed(std::ostream& output, MatchIter begin, MatchIter end);
@@ -145,6 +167,8 @@ private:
     CmdResult cmd_testread(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_stopwatch(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_perftest(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_perftest_batch(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_perftest_cycle(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_comment(std::ostream& output, MatchIter begin, MatchIter end);
 
     void test_random_add();
@@ -158,17 +182,34 @@ private:
     void test_area_name();
     void test_subarea_in_areas();
     void test_all_subareas_in_area();
+    void test_is_subarea_of();
+    void test_remove_area();
+    void test_move_subarea();
+    void test_subarea_count();
+    void test_area_of_place();
+    void test_places_in_area();
+    void test_place_count_in_area();
+    void test_area_info();
+    void test_areas_in_rect();
+    void test_overlapping_areas();
     void test_places_closest_to();
     void test_remove_place();
     void test_common_area_of_subareas();
+    void test_common_area_of_many();
+    void test_subarea_in_areas_batch();
     void test_ways_from();
     void test_way_coords();
     void test_remove_way();
     void test_route_any();
     void test_route_least_crossroads();
     void test_route_shortest_distance();
+    void test_distance_matrix();
+    void test_route_expansions();
     void test_route_with_cycle();
     void test_trim_ways();
+    void test_connected();
+    void test_reachable_within();
+    void test_places_reachable_within();
 
     void add_random_places_areas(unsigned int size, Coord min = {1,1}, Coord max = {10000, 10000});
     void add_random_ways(unsigned int n);
@@ -177,6 +218,8 @@ private:
     std::string print_area(AreaID id, std::ostream& output, bool nl = true);
     std::string print_way(WayID id, std::ostream& output, bool nl = true);
     std::string print_coord(Coord coord, std::ostream& output, bool nl = true);
+    std::vector<AreaID> parse_area_ids(std::string const& idsstr);
+    std::vector<AreaID> random_area_ids(unsigned int count);
 
     template <typename Type>
     Type random(Type start, Type end);
@@ -187,6 +230,10 @@ private:
 
     static PlaceType convert_string_to_placetype(std::string from);
     static std::string convert_placetype_to_string(PlaceType type);
+    static RouteMetric convert_string_to_routemetric(std::string from);
+    static std::string convert_routemetric_to_string(RouteMetric metric);
+    static RouteAlgorithm convert_string_to_routealgorithm(std::string from);
+    static std::string convert_routealgorithm_to_string(RouteAlgorithm algorithm);
 
     template<PlaceID(Datastructures::*MFUNC)()>
     CmdResult NoParPlaceCmd(std::ostream& output, MatchIter begin, MatchIter end);